@@ -12,6 +12,8 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * Processes that only read a buffer can share it: use
+//     bread_shared and brelse_shared instead.
 //
 // The implementation uses two state flags internally:
 // * B_VALID: the buffer data has been read from the disk.
@@ -57,7 +59,7 @@ binit(void)
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
-// In either case, return locked buffer.
+// In either case, return the buffer, referenced but not locked.
 static struct buf*
 bget(uint dev, uint blockno)
 {
@@ -70,7 +72,6 @@ bget(uint dev, uint blockno)
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
       release(&bcache.lock);
-      acquiresleep(&b->lock);
       return b;
     }
   }
@@ -85,7 +86,6 @@ bget(uint dev, uint blockno)
       b->flags = 0;
       b->refcnt = 1;
       release(&bcache.lock);
-      acquiresleep(&b->lock);
       return b;
     }
   }
@@ -99,12 +99,35 @@ bread(uint dev, uint blockno)
   struct buf *b;
 
   b = bget(dev, blockno);
+  acquiresleep(&b->lock);
   if((b->flags & B_VALID) == 0) {
     iderw(b);
   }
   return b;
 }
 
+// Return a buf with the contents of the indicated block,
+// locked shared: the caller may only read it.
+struct buf*
+bread_shared(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  acquiresleep_shared(&b->lock);
+  if((b->flags & B_VALID) == 0) {
+    // Read it in with the lock held exclusively. It stays
+    // valid while we hold our reference.
+    releasesleep_shared(&b->lock);
+    acquiresleep(&b->lock);
+    if((b->flags & B_VALID) == 0)
+      iderw(b);
+    releasesleep(&b->lock);
+    acquiresleep_shared(&b->lock);
+  }
+  return b;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -115,16 +138,11 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
-// Release a locked buffer.
+// Drop a reference to b.
 // Move to the head of the MRU list.
-void
-brelse(struct buf *b)
+static void
+bput(struct buf *b)
 {
-  if(!holdingsleep(&b->lock))
-    panic("brelse");
-
-  releasesleep(&b->lock);
-
   acquire(&bcache.lock);
   b->refcnt--;
   if (b->refcnt == 0) {
@@ -139,6 +157,28 @@ brelse(struct buf *b)
   
   release(&bcache.lock);
 }
+
+// Release a locked buffer.
+void
+brelse(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("brelse");
+
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Release a buffer locked by bread_shared.
+void
+brelse_shared(struct buf *b)
+{
+  if(!holdingsleep_shared(&b->lock))
+    panic("brelse_shared");
+
+  releasesleep_shared(&b->lock);
+  bput(b);
+}
 //PAGEBREAK!
 // Blank page.
 
@@ -0,0 +1,58 @@
+// Contended buffer lock benchmark. 1, 2, 4 and 8 processes stat()
+// the same file at once, so that they all want the sleep locks of
+// the root directory's inode and of its first block, held for a
+// few microseconds each time. Reports stat() calls per second, and
+// how many times a held sleep lock was got by spinning and how many
+// times its taker had to sleep.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+#define RUNTICKS 200
+#define HZ       100   // timer ticks per second
+
+void
+run(int nproc, char *path)
+{
+  struct stat st;
+  int i, n, total, fd[2], t0, spin0, sleep0;
+
+  pipe(fd);
+  spin0 = kstat(KS_SLEEPLOCKSPIN);
+  sleep0 = kstat(KS_SLEEPLOCKSLEEP);
+  t0 = uptime();
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0){
+      close(fd[0]);
+      for(n = 0; uptime() - t0 < RUNTICKS; n++)
+        stat(path, &st);
+      write(fd[1], &n, sizeof(n));
+      exit();
+    }
+  }
+  close(fd[1]);
+  total = 0;
+  for(i = 0; i < nproc; i++){
+    if(read(fd[0], &n, sizeof(n)) == sizeof(n))
+      total += n;
+    wait();
+  }
+  close(fd[0]);
+  printf(1, "buflockbench: %d procs: %d stats/s, %d spun, %d slept\n",
+         nproc, total * HZ / RUNTICKS, kstat(KS_SLEEPLOCKSPIN) - spin0,
+         kstat(KS_SLEEPLOCKSLEEP) - sleep0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *path = argc > 1 ? argv[1] : "/README";
+  int n;
+
+  printf(1, "buflockbench: %d CPUs\n", kstat(KS_NCPU));
+  for(n = 1; n <= 8; n *= 2)
+    run(n, path);
+  exit();
+}
@@ -0,0 +1,62 @@
+// Context switch benchmark: two processes bounce a byte back
+// and forth through a pair of pipes, so every round trip is two
+// switches. Reports the time per round trip and how many times
+// cr3 was loaded per switch.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+#define NROUND 20000
+
+int
+main(int argc, char *argv[])
+{
+  int ping[2], pong[2], i, pid, t0, t1, cr30, sw0, cr3, sw;
+  char c;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf(1, "ctxbench: pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "ctxbench: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit();
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  cr30 = kstat(KS_CR3LOAD);
+  sw0 = kstat(KS_CSWITCH);
+  t0 = uptime();
+  for(i = 0; i < NROUND; i++){
+    c = i;
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf(1, "ctxbench: pipe broke\n");
+      break;
+    }
+  }
+  t1 = uptime();
+  cr3 = kstat(KS_CR3LOAD) - cr30;
+  sw = kstat(KS_CSWITCH) - sw0;
+  close(ping[1]);
+  close(pong[0]);
+  wait();
+
+  if(t1 == t0)
+    t1 = t0 + 1;
+  printf(1, "ctxbench: %d round trips in %d ticks, %d per 100 ticks\n",
+         i, t1 - t0, i * 100 / (t1 - t0));
+  printf(1, "ctxbench: %d switches, %d cr3 loads (%d per 100 switches)\n",
+         sw, cr3, sw ? cr3 * 100 / sw : 0);
+  exit();
+}
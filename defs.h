@@ -2,6 +2,8 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
+struct lockstat;
 struct pipe;
 struct proc;
 struct rtcdate;
@@ -9,11 +11,14 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct vma;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bread_shared(uint, uint);
 void            brelse(struct buf*);
+void            brelse_shared(struct buf*);
 void            bwrite(struct buf*);
 
 // console.c
@@ -31,20 +36,26 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filesplice(struct file*, struct file*, int n);
+int             filereadv(struct file*, struct iovec*, int, int);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int, int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
-struct inode*   ialloc(uint, short);
+struct inode*   ialloc(uint, short, struct inode*);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
+void            ilock_shared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
+void            iunlock_shared(struct inode*);
 void            iunlockput(struct inode*);
+void            iunlockput_shared(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
@@ -68,6 +79,10 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kref(char*);
+int             krefcount(char*);
+char*           khugealloc(void);
+void            khugefree(char*);
 
 // kbd.c
 void            kbdintr(void);
@@ -79,6 +94,9 @@ extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+void            lapictimer(uint);
+uint            lapictimercount(void);
+void            lapicipi(int, int);
 void            microdelay(int);
 
 // log.c
@@ -86,6 +104,16 @@ void            initlog(int dev);
 void            log_write(struct buf*);
 void            begin_op();
 void            end_op();
+int             logwriteback(int);
+
+// mmap.c
+int             mmap(struct file*, uint, int, int, uint);
+int             mmapcheck(uint, uint);
+int             mmapfault(uint, uint);
+struct vma*     mmapfind(struct proc*, uint);
+int             mmapfork(struct proc*, struct proc*);
+int             munmap(uint, uint);
+void            munmapall(struct proc*);
 
 // mp.c
 extern int      ismp;
@@ -95,6 +123,14 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// pcache.c
+void            pcacheinit(void);
+char*           pcache_get(struct inode*, uint);
+void            pcache_inval(struct inode*, uint, uint);
+int             pcache_read(struct inode*, char*, uint, uint);
+void            pcache_write(struct inode*, char*, uint, uint);
+int             pcache_reclaim(void);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -103,11 +139,25 @@ int             pipewrite(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
 // proc.c
+int             clone(uint, uint, uint);
 int             cpuid(void);
 void            exit(void);
+int             fdalloc(struct file*);
+struct file*    fdget(int);
+void            fdrelease(void);
+int             fdgrow(struct proc*);
+struct file*    fdremove(int);
 int             fork(void);
+int             futexwait(uint, int);
+int             futexwake(uint, int);
+struct inode*   getcwd(void);
 int             growproc(int);
+int             join(int);
 int             kill(int);
+int             killthreads(void);
+void            kthread(char*, void (*)(void));
+void            mmlock(void);
+void            mmunlock(void);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
@@ -115,12 +165,27 @@ void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
+void            setcwd(struct inode*);
+int             setpriority(int, int);
+int             setsched(int);
+int             sleepuntil(uint64);
+void            timerexpire(uint64);
+char*           swapvictim(uint);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 
+// sched.c
+void            runqput(struct proc*);
+void            runqremove(struct proc*);
+struct proc*    runqpick(struct cpu*);
+int             runqwaiting(struct cpu*);
+void            runqkick(struct cpu*);
+int             schedtick(struct proc*);
+int             schedswitch(int);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
@@ -130,15 +195,23 @@ void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
+int             lockstat(int, struct lockstat*);
 void            pushcli(void);
 void            popcli(void);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+void            acquiresleep_shared(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
+void            releasesleep_shared(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+int             holdingsleep_shared(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// sysproc.c
+extern uint     kstats[];
+#define kstatinc(n) __sync_fetch_and_add(&kstats[(n)], 1)
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
@@ -148,10 +221,20 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            swapinit(int);
+char*           kallocuser(void);
+int             swapin(pte_t*);
+void            swapfree(uint);
+void            swapdup(uint);
+
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
 int             argstr(int, char**);
+int             argwptr(int, char**, int);
+int             checkptr(uint, int);
+int             checkwptr(uint, int);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
 void            syscall(void);
@@ -160,12 +243,18 @@ int             read_link_to_buf(char*, char*, uint);
 
 // timer.c
 void            timerinit(void);
+uint64          nsnow(void);
+uint            uptime(void);
+void            timeradd(struct proc*);
+void            timerdel(struct proc*);
+struct proc*    timerpop(struct cpu*, uint64);
+void            timerarm(void);
+int             timerintr(void);
 
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
 void            tvinit(void);
-extern struct spinlock tickslock;
 
 // uart.c
 void            uartinit(void);
@@ -178,6 +267,7 @@ void            kvmalloc(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
+int             allochugeuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
@@ -185,8 +275,19 @@ int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
+void            flushtlb(void);
+void            tlbshootdown(pde_t*);
+void            tlbpoll(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             pagefault(uint, uint);
+int             uvmprefault(uint, uint);
+int             uvmunshare(uint);
+int             uvmscratch(uint);
+int             uvmwritable(uint, uint);
+pte_t*          swapscan(pde_t*, uint*, uint);
+pte_t*          walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -20,6 +20,9 @@ exec(char *path, char **argv)
   struct proc *curproc = myproc();
   char sym_path[FILENAMESIZE];
 
+  // Only the leader can exec.
+  if(curproc->group != curproc)
+    return -1;
 
   begin_op();
   int result = read_link_to_buf(path, sym_path, FILENAMESIZE);
@@ -44,7 +47,7 @@ exec(char *path, char **argv)
     }
   }
 
-  ilock(ip);
+  ilock_shared(ip);
   pgdir = 0;
 
   // Check ELF header
@@ -67,14 +70,14 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
-      goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
     if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
+    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+      goto bad;
   }
-  iunlockput(ip);
+  iunlockput_shared(ip);
   end_op();
   ip = 0;
 
@@ -111,10 +114,14 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
-  // Commit to the user image.
+  // Commit to the user image. The other threads go first,
+  // now that the new image has loaded.
+  killthreads();
+  munmapall(curproc);
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
+  curproc->hugeheap = 0;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
@@ -125,7 +132,7 @@ exec(char *path, char **argv)
   if(pgdir)
     freevm(pgdir);
   if(ip){
-    iunlockput(ip);
+    iunlockput_shared(ip);
     end_op();
   }
   return -1;
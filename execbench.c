@@ -0,0 +1,95 @@
+// Exec benchmark: exec throughput, and the memory footprint
+// of many concurrent copies of one program (program text is
+// shared through the kernel's page cache).
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+#define NEXEC  200   // execs for the throughput test
+#define NCOPY   32   // concurrent copies for the footprint test
+
+int
+main(int argc, char *argv[])
+{
+  int i, pid, t0, t1, free0, free1, hit0, miss0;
+  int ready[2], hold[2];
+  char c, rfd[2], hfd[2];
+  char *xargv[] = { argv[0], "x", 0 };
+  char *wargv[] = { argv[0], "w", rfd, hfd, 0 };
+
+  if(argc == 2 && strcmp(argv[1], "x") == 0)
+    exit();
+  if(argc == 4 && strcmp(argv[1], "w") == 0){
+    // A copy for the footprint test: report in, wait to be released.
+    write(argv[2][0] - '0', "r", 1);
+    read(argv[3][0] - '0', &c, 1);
+    exit();
+  }
+
+  printf(1, "execbench: %d sequential execs\n", NEXEC);
+  hit0 = kstat(KS_PCHIT);
+  miss0 = kstat(KS_PCMISS);
+  t0 = uptime();
+  for(i = 0; i < NEXEC; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "execbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[0], xargv);
+      printf(1, "execbench: exec %s failed\n", argv[0]);
+      exit();
+    }
+    wait();
+  }
+  t1 = uptime();
+  if(t1 == t0)
+    t1 = t0 + 1;
+  printf(1, "execbench: %d ticks, %d execs per 100 ticks\n",
+         t1 - t0, NEXEC * 100 / (t1 - t0));
+  printf(1, "execbench: page cache %d hits %d misses\n",
+         kstat(KS_PCHIT) - hit0, kstat(KS_PCMISS) - miss0);
+
+  printf(1, "execbench: %d concurrent copies\n", NCOPY);
+  if(pipe(ready) < 0 || pipe(hold) < 0 || ready[1] > 9 || hold[0] > 9){
+    printf(1, "execbench: pipe failed\n");
+    exit();
+  }
+  rfd[0] = '0' + ready[1];
+  rfd[1] = 0;
+  hfd[0] = '0' + hold[0];
+  hfd[1] = 0;
+  free0 = kstat(KS_FREEPAGES);
+  for(i = 0; i < NCOPY; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "execbench: fork failed\n");
+      break;
+    }
+    if(pid == 0){
+      close(ready[0]);
+      close(hold[1]);
+      exec(argv[0], wargv);
+      printf(1, "execbench: exec %s failed\n", argv[0]);
+      exit();
+    }
+  }
+  close(ready[1]);
+  close(hold[0]);
+  for(i = 0; i < NCOPY; i++)
+    if(read(ready[0], &c, 1) != 1)
+      break;
+  free1 = kstat(KS_FREEPAGES);
+  printf(1, "execbench: %d copies use %d pages, %d pages per copy\n",
+         i, free0 - free1, i ? (free0 - free1) / i : 0);
+  printf(1, "execbench: page cache holds %d pages\n", kstat(KS_PCPAGES));
+
+  close(hold[1]);
+  while(wait() >= 0)
+    ;
+  close(ready[0]);
+  exit();
+}
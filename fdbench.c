@@ -0,0 +1,103 @@
+// File descriptor benchmark. NPROC processes each open a file
+// NOPEN times and keep the descriptors, more than the old limits
+// of 16 per process and 100 in all, then time NCYCLE open/close
+// and dup/close cycles with all of them still open. Reports the
+// cycles per second of each, and checks that the lowest free
+// descriptor is handed out.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+#define NOPEN  1000
+#define NCYCLE 20000
+#define NPROC  4
+
+char *path = "fdbench.tmp";
+
+int
+rate(uint64 *t0, int n)
+{
+  uint64 t1;
+  uint ms;
+
+  nsuptime(&t1);
+  ms = (uint)(t1 - *t0) / 1000000;
+  if(ms == 0)
+    ms = 1;
+  return n * 1000 / ms;
+}
+
+void
+child(int me, int out)
+{
+  int i, fd, r[2];
+  uint64 t0;
+
+  for(i = 0; i < NOPEN; i++){
+    if((fd = open(path, O_RDONLY)) < 0){
+      printf(1, "fdbench: proc %d: open %d failed\n", me, i);
+      exit();
+    }
+  }
+
+  // A hole low down must be the next fd handed out.
+  close(10);
+  if((fd = open(path, O_RDONLY)) != 10)
+    printf(1, "fdbench: proc %d: got fd %d, not 10\n", me, fd);
+
+  nsuptime(&t0);
+  for(i = 0; i < NCYCLE; i++){
+    if((fd = open(path, O_RDONLY)) < 0){
+      printf(1, "fdbench: proc %d: open failed\n", me);
+      exit();
+    }
+    close(fd);
+  }
+  r[0] = rate(&t0, NCYCLE);
+
+  nsuptime(&t0);
+  for(i = 0; i < NCYCLE; i++)
+    close(dup(0));
+  r[1] = rate(&t0, NCYCLE);
+
+  write(out, r, sizeof(r));
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, p[2], r[2], nopen, ndup;
+
+  if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+    printf(1, "fdbench: cannot create %s\n", path);
+    exit();
+  }
+  close(fd);
+
+  printf(1, "fdbench: %d CPUs, %d procs with %d fds open each\n",
+         kstat(KS_NCPU), NPROC, NOPEN);
+  pipe(p);
+  for(i = 0; i < NPROC; i++)
+    if(fork() == 0){
+      close(p[0]);
+      child(i, p[1]);
+    }
+  close(p[1]);
+  nopen = ndup = 0;
+  for(i = 0; i < NPROC; i++){
+    if(read(p[0], r, sizeof(r)) == sizeof(r)){
+      nopen += r[0];
+      ndup += r[1];
+    }
+    wait();
+  }
+  close(p[0]);
+  printf(1, "fdbench: open/close: %d cycles/s per proc\n", nopen / NPROC);
+  printf(1, "fdbench: dup/close:  %d cycles/s per proc\n", ndup / NPROC);
+  unlink(path);
+  exit();
+}
@@ -5,15 +5,24 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "stat.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
+
+// File structures are made a page at a time, as they are needed,
+// up to NFILE of them, and are kept on a free list when closed.
+#define FILEPERPG (PGSIZE / sizeof(struct file))
 
 struct devsw devsw[NDEV];
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct file *free;   // unused files
+  int nfile;           // files made so far
 } ftable;
 
 void
@@ -22,6 +31,28 @@ fileinit(void)
   initlock(&ftable.lock, "ftable");
 }
 
+// Add a page of unused files to the free list.
+// Returns 0, or -1 if there are NFILE files already
+// or no memory. The ftable lock must be held.
+static int
+growftable(void)
+{
+  struct file *f;
+  char *mem;
+  int i;
+
+  if(ftable.nfile >= NFILE || (mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  f = (struct file*)mem;
+  for(i = 0; i < FILEPERPG && ftable.nfile < NFILE; i++, f++){
+    f->next = ftable.free;
+    ftable.free = f;
+    ftable.nfile++;
+  }
+  return 0;
+}
+
 // Allocate a file structure.
 struct file*
 filealloc(void)
@@ -29,15 +60,16 @@ filealloc(void)
   struct file *f;
 
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  if(ftable.free == 0 && growftable() < 0){
+    release(&ftable.lock);
+    return 0;
   }
+  f = ftable.free;
+  ftable.free = f->next;
+  f->next = 0;
+  f->ref = 1;
   release(&ftable.lock);
-  return 0;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -68,6 +100,8 @@ fileclose(struct file *f)
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
+  f->next = ftable.free;
+  ftable.free = f;
   release(&ftable.lock);
 
   if(ff.type == FD_PIPE)
@@ -84,14 +118,23 @@ int
 filestat(struct file *f, struct stat *st)
 {
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    ilock_shared(f->ip);
     stati(f->ip, st);
-    iunlock(f->ip);
+    iunlock_shared(f->ip);
     return 0;
   }
   return -1;
 }
 
+// Whether another reader can be using f's offset: f is open in
+// another process too, or in a process with other threads, which
+// share the fd table.
+static int
+offshared(struct file *f)
+{
+  return f->ref > 1 || myproc()->group->nthread > 1;
+}
+
 // Read from file f.
 int
 fileread(struct file *f, char *addr, int n)
@@ -103,15 +146,206 @@ fileread(struct file *f, char *addr, int n)
   if(f->type == FD_PIPE)
     return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    // Readers share the inode lock, unless another can be using
+    // f->off (see offshared): the exclusive lock keeps it consistent.
+    // Device reads (consoleread) drop and retake the lock, which
+    // must therefore be exclusive. An open inode's type is fixed.
+    if(offshared(f) || f->ip->type == T_DEV){
+      ilock(f->ip);
+      if((r = readi(f->ip, addr, f->off, n)) > 0)
+        f->off += r;
+      iunlock(f->ip);
+      return r;
+    }
+    ilock_shared(f->ip);
     if((r = readi(f->ip, addr, f->off, n)) > 0)
       f->off += r;
-    iunlock(f->ip);
+    iunlock_shared(f->ip);
     return r;
   }
   panic("fileread");
 }
 
+// Move up to n bytes from file in, at its offset, to file out,
+// which may be a pipe or another file, without a trip through
+// user memory. The bytes come from the page cache and go straight
+// into the pipe's ring or through writei(), one page at a time.
+// Returns the number of bytes moved (0 at the end of in), or -1.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  struct inode *ip = in->ip;
+  char *page;
+  uint off;
+  int m, r, done, excl;
+
+  if(in->type != FD_INODE || !in->readable || !out->writable)
+    return -1;
+  // See fileread() for the choice of lock.
+  excl = offshared(in);
+  for(done = 0; done < n; done += r){
+    r = 0;
+    if(excl)
+      ilock(ip);
+    else
+      ilock_shared(ip);
+    off = in->off;
+    page = 0;
+    if(ip->type != T_FILE)
+      r = -1;   // a device or directory: nothing to share
+    else if(off < ip->size){
+      m = PGSIZE - off % PGSIZE;
+      if(m > n - done)
+        m = n - done;
+      if(m > ip->size - off)
+        m = ip->size - off;
+      // Claim the bytes while the lock is held, so that
+      // another splice of in moves the ones after them.
+      if((page = pcache_get(ip, PGROUNDDOWN(off))) != 0)
+        in->off = off + m;
+    }
+    if(excl)
+      iunlock(ip);
+    else
+      iunlock_shared(ip);
+    if(r < 0)
+      return done > 0 ? done : -1;
+    if(page == 0)
+      break;   // end of file, or out of memory
+
+    r = filewrite(out, page + off % PGSIZE, m);
+    kfree(page);
+    if(r != m){
+      // Give back the bytes not moved, unless the offset
+      // has been used since.
+      ilock(ip);
+      if(in->off == off + m)
+        in->off = off + (r > 0 ? r : 0);
+      iunlock(ip);
+      if(r > 0)
+        done += r;
+      return done > 0 ? done : -1;
+    }
+  }
+  return done;
+}
+
+// Read into the cnt buffers of iov from file f, at offset off,
+// or at f->off, which advances, if off is -1. The whole vector is
+// read under one lock of the inode. A pipe fills only the first
+// buffer that is not empty, as one read() would.
+// Returns the number of bytes read, or -1.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt, int off)
+{
+  int i, r, total, excl;
+  uint o;
+
+  if(f->readable == 0)
+    return -1;
+  if(f->type == FD_PIPE){
+    if(off != -1)
+      return -1;
+    for(i = 0; i < cnt; i++)
+      if(iov[i].len > 0)
+        return piperead(f->pipe, iov[i].base, iov[i].len);
+    return 0;
+  }
+  if(f->type != FD_INODE)
+    panic("filereadv");
+
+  // See fileread() for the choice of lock.
+  excl = (off == -1 && offshared(f)) || f->ip->type == T_DEV;
+  if(excl)
+    ilock(f->ip);
+  else
+    ilock_shared(f->ip);
+  o = off == -1 ? f->off : off;
+  total = 0;
+  for(i = 0; i < cnt; i++){
+    if((r = readi(f->ip, iov[i].base, o, iov[i].len)) < 0){
+      if(total == 0)
+        total = -1;
+      break;
+    }
+    o += r;
+    total += r;
+    if(r < iov[i].len)
+      break;
+  }
+  if(off == -1 && total > 0)
+    f->off = o;
+  if(excl)
+    iunlock(f->ip);
+  else
+    iunlock_shared(f->ip);
+  return total;
+}
+
+// Write the cnt buffers of iov to file f, at offset off, or at
+// f->off, which advances, if off is -1. A file is written under
+// one lock of the inode and one log transaction for each
+// transaction's worth of bytes (see filewrite), however many
+// buffers they come from.
+// Returns the number of bytes written, or -1.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt, int off)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+  int i, r, m, room, done, total;
+  uint o;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_PIPE){
+    if(off != -1)
+      return -1;
+    total = 0;
+    for(i = 0; i < cnt; i++){
+      if(pipewrite(f->pipe, iov[i].base, iov[i].len) < 0)
+        return total > 0 ? total : -1;
+      total += iov[i].len;
+    }
+    return total;
+  }
+  if(f->type != FD_INODE)
+    panic("filewritev");
+
+  total = 0;
+  o = off;
+  i = done = 0;   // buffer i, done bytes of it written
+  while(i < cnt){
+    begin_op();
+    ilock(f->ip);
+    if(off == -1)
+      o = f->off;
+    r = 0;
+    for(room = max; i < cnt && room > 0; room -= r){
+      m = iov[i].len - done;
+      if(m > room)
+        m = room;
+      if(m > 0 && (r = writei(f->ip, (char*)iov[i].base + done, o, m)) != m)
+        break;
+      if(m == 0)
+        r = 0;
+      o += r;
+      done += r;
+      total += r;
+      if(done == iov[i].len){
+        i++;
+        done = 0;
+      }
+    }
+    if(off == -1)
+      f->off = o;
+    iunlock(f->ip);
+    end_op();
+    if(i < cnt && room > 0)
+      return total > 0 ? total : -1;   // writei() failed
+  }
+  return total;
+}
+
 //PAGEBREAK!
 // Write to file f.
 int
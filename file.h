@@ -6,6 +6,7 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  struct file *next;  // next on the free list
 };
 
 
@@ -14,6 +15,8 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *next; // hash chain
+  struct inode *lrunext, *lruprev; // LRU list, while ref is 0
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
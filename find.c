@@ -33,14 +33,14 @@ parseTag(const char* arg, char *tagKey, char *tagValue){
   int i=0;
   while (arg[i] != '='){
     if (arg[i] == '\0'){
-      printf(1,"Invalid use of type (no =)\n");
+      fprintf(sout, "Invalid use of type (no =)\n");
       exit();
     }
     i++;
   }
 
   if (i==0){
-    printf(1,"Invalid use of type (no key)\n");
+    fprintf(sout, "Invalid use of type (no key)\n");
     exit();
   }
 
@@ -56,7 +56,7 @@ parseTag(const char* arg, char *tagKey, char *tagValue){
   }
 
   if (var_len==0){
-    printf(1,"Invalid use of type (no value)\n");
+    fprintf(sout, "Invalid use of type (no value)\n");
     exit();
   }
 
@@ -163,7 +163,7 @@ find(char *path)
     }
 
     if(strlen(path) + 1 + DIRSIZ + 1 > sizeof buf){
-      printf(1, "find: path too long\n");
+      fprintf(sout, "find: path too long\n");
       break;
     }
 
@@ -195,7 +195,7 @@ find(char *path)
   }
 
   if (print) {
-    printf(1, "%s\n", path);
+    fprintf(sout, "%s\n", path);
   }
 
   close(fd);
@@ -206,7 +206,7 @@ main(int argc, char *argv[])
 {
   int i;
   if (argc < 2 || argv[1][0] == '-') {
-    printf(1,"Invalid use of find\n");
+    fprintf(sout, "Invalid use of find\n");
     exit();
   }
 
@@ -222,7 +222,7 @@ main(int argc, char *argv[])
 
       i++;
       if (i >= argc || argv[i][0] == '-') {
-        printf(1,"parameter name without value\n");
+        fprintf(sout, "parameter name without value\n");
         exit();
       }
       name = argv[i];
@@ -232,7 +232,7 @@ main(int argc, char *argv[])
 
       i++;
       if (i >= argc) {
-        printf(1,"parameter size without value\n");
+        fprintf(sout, "parameter size without value\n");
         exit();
       }
 
@@ -248,7 +248,7 @@ main(int argc, char *argv[])
         int j;
         for (j=0; j< strlen(argv[i]) ; j++) {
           if (argv[i][j] < '0' || argv[i][j] > '9' ) {
-            printf(1,"invalid size: %s\n",argv[i]);
+            fprintf(sout, "invalid size: %s\n",argv[i]);
             exit();
           }
 
@@ -261,11 +261,11 @@ main(int argc, char *argv[])
 
       i++;
       if (i >= argc || argv[i][0] == '-') {
-        printf(1,"parameter type without value\n");
+        fprintf(sout, "parameter type without value\n");
         exit();
       }
       if (!(strcmp(argv[i],"d") == 0 || strcmp(argv[i],"f") == 0 || strcmp(argv[i],"s") == 0)) {
-        printf(1,"Invalid type: %s\n", argv[i]);
+        fprintf(sout, "Invalid type: %s\n", argv[i]);
         exit();
       }
       type = argv[i][0];
@@ -275,14 +275,14 @@ main(int argc, char *argv[])
 
       i++;
       if (i >= argc || argv[i][0] == '-') {
-        printf(1,"parameter tag without value\n");
+        fprintf(sout, "parameter tag without value\n");
         exit();
       }
       parseTag(argv[i], tagKey, tagValue);
 
     }
     else {
-      printf(1,"Invalid parameter: %s\n" , argv[i]);
+      fprintf(sout, "Invalid parameter: %s\n" , argv[i]);
       exit();
     }
   }
@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "kstat.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
@@ -51,28 +52,88 @@ bzero(int dev, int bno)
 }
 
 // Blocks.
+//
+// The disk is split into block groups (see fs.h), each with its own
+// free map, inodes and data blocks. gtab keeps counts of the free
+// blocks, free inodes and directories in each group, under a lock
+// per group, so that allocators can pick a group without reading
+// the disk and processes allocating in different groups do not
+// contend. The free maps themselves are protected by their buffer
+// locks. The counts are only hints.
+
+#define NGROUP 64
+
+struct group {
+  struct spinlock lock;
+  int nbfree;       // free blocks
+  int nifree;       // free inodes
+  int ndir;         // directories
+};
+
+struct {
+  struct group g[NGROUP];
+} gtab;
 
-// Allocate a zeroed disk block.
+// Number of blocks in group g; the last may be short.
 static uint
-balloc(uint dev)
+gsize(uint g)
+{
+  if(g == sb.ngroups - 1)
+    return sb.size - GSTART(g, sb);
+  return sb.bpg;
+}
+
+// Add n to the counter *cnt of group g.
+static void
+gcount(uint g, int *cnt, int n)
+{
+  acquire(&gtab.g[g].lock);
+  *cnt += n;
+  release(&gtab.g[g].lock);
+}
+
+// Allocate a block in group g.
+// Returns its number, or 0 if the group is full.
+static uint
+bgalloc(uint dev, uint g)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint bi, n;
+  int m;
+
+  n = gsize(g);
+  bp = bread(dev, GSTART(g, sb));
+  for(bi = 0; bi < n; bi++){
+    if(bi % 8 == 0 && bp->data[bi/8] == 0xff){
+      bi += 7;
+      continue;
+    }
+    m = 1 << (bi % 8);
+    if((bp->data[bi/8] & m) == 0){  // Is block free?
+      bp->data[bi/8] |= m;  // Mark block in use.
+      log_write(bp);
+      brelse(bp);
+      gcount(g, &gtab.g[g].nbfree, -1);
+      return GSTART(g, sb) + bi;
+    }
+  }
+  brelse(bp);
+  return 0;
+}
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+// Allocate a zeroed disk block for inode inum,
+// in inum's group if that has a free block.
+static uint
+balloc(uint dev, uint inum)
+{
+  uint b, g, i;
+
+  g = inum / sb.ipg;
+  for(i = 0; i < sb.ngroups; i++, g = (g + 1) % sb.ngroups){
+    if(gtab.g[g].nbfree > 0 && (b = bgalloc(dev, g)) != 0){
+      bzero(dev, b);
+      return b;
     }
-    brelse(bp);
   }
   panic("balloc: out of blocks");
 }
@@ -84,15 +145,15 @@ bfree(int dev, uint b)
   struct buf *bp;
   int bi, m;
 
-  readsb(dev, &sb);
   bp = bread(dev, BBLOCK(b, sb));
-  bi = b % BPB;
+  bi = BINDEX(b, sb);
   m = 1 << (bi % 8);
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
+  gcount(BGROUP(b, sb), &gtab.g[BGROUP(b, sb)].nbfree, 1);
 }
 
 // Inodes.
@@ -120,18 +181,18 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a cache entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in cache: ip->ref tracks the number of
+//   in-memory pointers to the entry (open files and current
+//   directories). iget() finds or creates a cache entry and
+//   increments its ref; iput() decrements ref. An entry whose
+//   ref is zero stays cached, on an LRU list, until iget()
+//   needs it for another inode.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
-//   ilock() reads the inode from
-//   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ilock() reads the inode from the disk and sets
+//   ip->valid, while iput() clears ip->valid when it frees
+//   the inode and iget() when it recycles the entry.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -158,58 +219,194 @@ bfree(int dev, uint b)
 // The icache.lock spin-lock protects the allocation of icache
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// holds, one must hold icache.lock while using any of those fields,
+// or the hash chains and the LRU list.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+//
+// Entries are made a page at a time, as they are needed, up to
+// NINODE of them, and are found through a hash on (dev, inum).
+// New entries go to the head of the LRU list and entries whose
+// ref falls to zero to its tail, so iget() takes an unused entry
+// first, then makes more, and only then recycles the least
+// recently used inode. An entry not yet used has inum 0.
+
+#define IPERPG (PGSIZE / sizeof(struct inode))
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *hash[NIHASH];
+  struct inode *lruhead;   // unreferenced, least recently used first
+  struct inode *lrutail;
+  int ninode;              // entries made so far
 } icache;
 
+// Inode allocation.
+//
+// ialloc() puts a new directory in a group with at least the
+// average number of free inodes and free blocks and the fewest
+// directories, as the Orlov allocator spreads top-level
+// directories, and a new file in its parent directory's group, as
+// soon after the parent as it can, so that siblings share inode
+// blocks and listing a directory reads few of them, and their data
+// is near. Groups hold few inodes, so every directory is spread,
+// not only those at the top.
+
+// Count the free blocks, free inodes and directories in each group.
+static void
+gtabinit(int dev)
+{
+  struct buf *bp;
+  struct dinode *dip;
+  struct group *gp;
+  uint g, bi, inum;
+
+  if(sb.ngroups > NGROUP)
+    panic("gtabinit: too many groups");
+  for(g = 0; g < sb.ngroups; g++){
+    gp = &gtab.g[g];
+    initlock(&gp->lock, "group");
+    bp = bread(dev, GSTART(g, sb));
+    for(bi = 0; bi < gsize(g); bi++)
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        gp->nbfree++;
+    brelse(bp);
+    bp = 0;
+    for(inum = g * sb.ipg; inum < (g + 1) * sb.ipg; inum++){
+      if(inum % IPB == 0){
+        if(bp)
+          brelse(bp);
+        bp = bread(dev, IBLOCK(inum, sb));
+      }
+      dip = (struct dinode*)bp->data + inum%IPB;
+      if(inum == 0)
+        continue;
+      if(dip->type == 0)
+        gp->nifree++;
+      else if(dip->type == T_DIR)
+        gp->ndir++;
+    }
+    if(bp)
+      brelse(bp);
+  }
+}
+
+// Inode inum of type type was allocated (n = 1) or freed (n = -1).
+static void
+gtabinode(uint inum, short type, int n)
+{
+  struct group *gp = &gtab.g[inum / sb.ipg];
+
+  acquire(&gp->lock);
+  gp->nifree -= n;
+  if(type == T_DIR)
+    gp->ndir += n;
+  release(&gp->lock);
+}
+
+// Choose the group for a new directory. Reads the counts
+// without the locks: they are only hints.
+static uint
+gspread(void)
+{
+  struct group *gp, *best;
+  int ifree, bfree;
+  uint g;
+
+  ifree = bfree = 0;
+  for(g = 0; g < sb.ngroups; g++){
+    ifree += gtab.g[g].nifree;
+    bfree += gtab.g[g].nbfree;
+  }
+  ifree /= sb.ngroups;
+  bfree /= sb.ngroups;
+  best = 0;
+  for(gp = gtab.g; gp < &gtab.g[sb.ngroups]; gp++){
+    if(gp->nifree == 0 || gp->nifree < ifree || gp->nbfree < bfree)
+      continue;
+    if(best == 0 || gp->ndir < best->ndir ||
+       (gp->ndir == best->ndir && gp->nifree > best->nifree))
+      best = gp;
+  }
+  if(best == 0)
+    return 0;
+  return best - gtab.g;
+}
+
 void
 iinit(int dev)
 {
-  int i = 0;
-
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
- inodestart %d bmap start %d\n", sb.size, sb.nblocks,
-          sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
-          sb.bmapstart);
+ groupstart %d ngroups %d\n", sb.size, sb.nblocks,
+          sb.ninodes, sb.nlog, sb.logstart, sb.groupstart,
+          sb.ngroups);
+  gtabinit(dev);
 }
 
 static struct inode* iget(uint dev, uint inum);
 
-//PAGEBREAK!
-// Allocate an inode on device dev.
-// Mark it as allocated by  giving it type type.
-// Returns an unlocked but allocated and referenced inode.
-struct inode*
-ialloc(uint dev, short type)
+// Look for a free inode in [from, to), reading each inode
+// block once, and mark it allocated by giving it type type.
+// Returns its number, or 0 if there is none.
+static uint
+iscan(uint dev, short type, uint from, uint to)
 {
-  int inum;
   struct buf *bp;
   struct dinode *dip;
+  uint inum;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
+  bp = 0;
+  for(inum = from; inum < to; inum++){
+    if(bp == 0 || inum % IPB == 0){
+      if(bp)
+        brelse(bp);
+      bp = bread(dev, IBLOCK(inum, sb));
+    }
     dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
+    if(inum != 0 && dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
-      return iget(dev, inum);
+      return inum;
     }
+  }
+  if(bp)
     brelse(bp);
+  return 0;
+}
+
+//PAGEBREAK!
+// Allocate an inode on device dev, for a new entry in directory
+// dp. Mark it as allocated by giving it type type.
+// Returns an unlocked but allocated and referenced inode.
+struct inode*
+ialloc(uint dev, short type, struct inode *dp)
+{
+  uint g, i, inum, start;
+
+  if(type == T_DIR){
+    g = gspread();
+    start = g * sb.ipg;
+  } else {
+    g = dp->inum / sb.ipg;
+    start = dp->inum;
+  }
+  for(i = 0; i < sb.ngroups; i++, g = (g + 1) % sb.ngroups){
+    if(i > 0)
+      start = g * sb.ipg;
+    if(gtab.g[g].nifree == 0)
+      continue;
+    if((inum = iscan(dev, type, start, (g + 1) * sb.ipg)) != 0 ||
+       (inum = iscan(dev, type, g * sb.ipg, start)) != 0){
+      gtabinode(inum, type, 1);
+      return iget(dev, inum);
+    }
   }
   panic("ialloc: no inodes");
 }
@@ -238,37 +435,121 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+static uint
+ihash(uint dev, uint inum)
+{
+  return (dev*7 + inum) % NIHASH;
+}
+
+static void
+lruremove(struct inode *ip)
+{
+  if(ip->lruprev)
+    ip->lruprev->lrunext = ip->lrunext;
+  else
+    icache.lruhead = ip->lrunext;
+  if(ip->lrunext)
+    ip->lrunext->lruprev = ip->lruprev;
+  else
+    icache.lrutail = ip->lruprev;
+  ip->lrunext = ip->lruprev = 0;
+}
+
+// Put an unreferenced ip at the tail of the LRU list.
+static void
+lruappend(struct inode *ip)
+{
+  ip->lrunext = 0;
+  ip->lruprev = icache.lrutail;
+  if(icache.lrutail)
+    icache.lrutail->lrunext = ip;
+  else
+    icache.lruhead = ip;
+  icache.lrutail = ip;
+}
+
+// Add a page of unused entries to the head of the LRU list.
+// Returns 0, or -1 if there are NINODE entries already
+// or no memory. Caller must hold icache.lock.
+static int
+growicache(void)
+{
+  struct inode *ip;
+  char *mem;
+  int i;
+
+  if(icache.ninode >= NINODE || (mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  ip = (struct inode*)mem;
+  for(i = 0; i < IPERPG && icache.ninode < NINODE; i++, ip++){
+    initsleeplock(&ip->lock, "inode");
+    ip->lrunext = icache.lruhead;
+    if(icache.lruhead)
+      icache.lruhead->lruprev = ip;
+    else
+      icache.lrutail = ip;
+    icache.lruhead = ip;
+    icache.ninode++;
+    kstats[KS_ICINODES]++;
+  }
+  return 0;
+}
+
+// Take ip out of its hash chain.
+// Caller must hold icache.lock.
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  for(pp = &icache.hash[ihash(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->next)
+    if(*pp == 0)
+      panic("iunhash");
+  *pp = ip->next;
+  ip->next = 0;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
+  uint h;
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  h = ihash(dev, inum);
+  for(ip = icache.hash[h]; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        lruremove(ip);
       release(&icache.lock);
+      kstatinc(KS_ICHIT);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
+  kstatinc(KS_ICMISS);
 
   // Recycle an inode cache entry.
-  if(empty == 0)
+  ip = icache.lruhead;
+  if((ip == 0 || ip->inum != 0) && growicache() == 0)
+    ip = icache.lruhead;
+  if(ip == 0)
     panic("iget: no inodes");
+  lruremove(ip);
+  if(ip->inum != 0)
+    iunhash(ip);
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->next = icache.hash[h];
+  icache.hash[h] = ip;
   release(&icache.lock);
 
   return ip;
@@ -299,7 +580,7 @@ ilock(struct inode *ip)
   acquiresleep(&ip->lock);
 
   if(ip->valid == 0){
-    bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+    bp = bread_shared(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
     ip->type = dip->type;
     ip->major = dip->major;
@@ -307,7 +588,7 @@ ilock(struct inode *ip)
     ip->nlink = dip->nlink;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
-    brelse(bp);
+    brelse_shared(bp);
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -324,9 +605,37 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock the given inode shared, for reading only: any number of
+// processes can hold it shared at the same time.
+// Reads the inode from disk if necessary.
+void
+ilock_shared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilock_shared");
+
+  if(ip->valid == 0){
+    // Read it in with the lock held exclusively. It stays
+    // valid while we hold our reference.
+    ilock(ip);
+    iunlock(ip);
+  }
+  acquiresleep_shared(&ip->lock);
+}
+
+// Unlock an inode locked by ilock_shared.
+void
+iunlock_shared(struct inode *ip)
+{
+  if(ip == 0 || !holdingsleep_shared(&ip->lock) || ip->ref < 1)
+    panic("iunlock_shared");
+
+  releasesleep_shared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode cache entry can
-// be recycled.
+// If that was the last reference, the inode cache entry stays
+// valid at the tail of the LRU list until it is recycled.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -342,6 +651,7 @@ iput(struct inode *ip)
     if(r == 1){
       // inode has no links and no other references: truncate and free.
       itrunc(ip);
+      gtabinode(ip->inum, ip->type, -1);
       ip->type = 0;
       iupdate(ip);
       ip->valid = 0;
@@ -350,7 +660,8 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  if(--ip->ref == 0)
+    lruappend(ip);
   release(&icache.lock);
 }
 
@@ -362,6 +673,13 @@ iunlockput(struct inode *ip)
   iput(ip);
 }
 
+void
+iunlockput_shared(struct inode *ip)
+{
+  iunlock_shared(ip);
+  iput(ip);
+}
+
 //PAGEBREAK!
 // Inode content
 //
@@ -371,7 +689,8 @@ iunlockput(struct inode *ip)
 // listed in block ip->addrs[NDIRECT].
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap allocates one. Files have no
+// holes, so readi() never allocates, and may hold ip->lock shared.
 static uint
 bmap(struct inode *ip, uint bn)
 {
@@ -380,7 +699,7 @@ bmap(struct inode *ip, uint bn)
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = balloc(ip->dev, ip->inum);
     return addr;
   }
   bn -= NDIRECT;
@@ -388,11 +707,11 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT) {
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = balloc(ip->dev, ip->inum);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      a[bn] = addr = balloc(ip->dev, ip->inum);
       log_write(bp);
     }
 
@@ -404,13 +723,13 @@ bmap(struct inode *ip, uint bn)
   if (bn < NDINDIRECT) {
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT + 1]) == 0) {
-      ip->addrs[NDIRECT + 1] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT + 1] = addr = balloc(ip->dev, ip->inum);
     }
 
     bp = bread(ip->dev, addr);
     a = (uint*) bp->data;
     if ((addr = a[bn / NINDIRECT]) == 0) {
-      a[bn / NINDIRECT] = addr = balloc(ip->dev);
+      a[bn / NINDIRECT] = addr = balloc(ip->dev, ip->inum);
       log_write(bp);
     }
     brelse(bp);
@@ -419,7 +738,7 @@ bmap(struct inode *ip, uint bn)
     bp = bread(ip->dev, addr);
     a = (uint*) bp->data;
     if ((addr = a[bn % NINDIRECT]) == 0) {
-      a[bn % NINDIRECT] = addr = balloc(ip->dev);
+      a[bn % NINDIRECT] = addr = balloc(ip->dev, ip->inum);
       log_write(bp);
     }
 
@@ -442,6 +761,7 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  pcache_inval(ip, 0, ip->size);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -479,7 +799,7 @@ stati(struct inode *ip, struct stat *st)
 
 //PAGEBREAK!
 // Read data from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, shared or exclusive.
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
@@ -498,10 +818,12 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
+    if(pcache_read(ip, dst, off, m) == 0)
+      continue;
+    bp = bread_shared(ip->dev, bmap(ip, off/BSIZE));
     memmove(dst, bp->data + off%BSIZE, m);
-    brelse(bp);
+    brelse_shared(bp);
   }
   return n;
 }
@@ -533,6 +855,7 @@ writei(struct inode *ip, char *src, uint off, uint n)
     log_write(bp);
     brelse(bp);
   }
+  pcache_write(ip, src - n, off - n, n);
 
   if(n > 0 && off > ip->size){
     ip->size = off;
@@ -552,6 +875,7 @@ namecmp(const char *s, const char *t)
 
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Caller must hold dp->lock, shared or exclusive.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
@@ -660,24 +984,24 @@ namex(char *path, int nameiparent, char *name)
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
-    ip = idup(myproc()->cwd);
+    ip = getcwd();
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilock_shared(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlockput_shared(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      iunlock(ip);
+      iunlock_shared(ip);
       return ip;
     }
     if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
+      iunlockput_shared(ip);
       return 0;
     }
-    iunlockput(ip);
+    iunlockput_shared(ip);
     ip = next;
   }
   if(nameiparent){
@@ -716,7 +1040,7 @@ fs_ftag(struct file *file_ptr, char *key, char *val) {
   ilock(ip);
 
   if ((ip->tags_counter == 0) && (ip->tags == 0)) {
-      ip->tags = balloc(ip->dev);
+      ip->tags = balloc(ip->dev, ip->inum);
   }
 
   bp = bread(ip->dev, ip->tags);
@@ -807,15 +1131,15 @@ fs_gettag(struct file *file_ptr,char *key,char *buf) {
   int i, j;
 
   ip = file_ptr->ip;
-  ilock(ip);
+  ilock_shared(ip);
 
   if ((ip->tags_counter == 0) || (ip->tags == 0)) {
     /* first tag */
-    iunlock(ip);
+    iunlock_shared(ip);
     return -1;
   }
 
-  bp = bread(ip->dev, ip->tags);
+  bp = bread_shared(ip->dev, ip->tags);
   i = 0;
   j = 0;
   while (i < ip->tags_counter) {
@@ -824,10 +1148,8 @@ fs_gettag(struct file *file_ptr,char *key,char *buf) {
       !(memcmp(key, &(bp->data[j]), strlen(key)))) {
       memmove(buf,&bp->data[j+10], 30);
 
-      log_write(bp);
-      brelse(bp);
-      iupdate(ip);
-      iunlock(ip);
+      brelse_shared(bp);
+      iunlock_shared(ip);
       return strlen(buf);
     }
     if (bp->data[j] == 0)
@@ -837,9 +1159,7 @@ fs_gettag(struct file *file_ptr,char *key,char *buf) {
     j += 40;
   }
 
-  log_write(bp);
-  brelse(bp);
-  iupdate(ip);
-  iunlock(ip);
+  brelse_shared(bp);
+  iunlock_shared(ip);
   return -1;
 }
@@ -6,8 +6,14 @@
 #define BSIZE 512  // block size
 
 // Disk layout:
-// [ boot block | super block | log | inode blocks |
-//                                          free bit map | data blocks]
+// [ boot block | super block | log | group 0 | group 1 | ... ]
+//
+// and each block group holds
+// [ free bit map block | inode blocks | data blocks ]
+//
+// The free bit map of a group covers the blocks of that group, and
+// group g holds inodes g*ipg to (g+1)*ipg-1. The last group may have
+// fewer than bpg blocks.
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
@@ -17,8 +23,12 @@ struct superblock {
   uint ninodes;      // Number of inodes.
   uint nlog;         // Number of log blocks
   uint logstart;     // Block number of first log block
-  uint inodestart;   // Block number of first inode block
-  uint bmapstart;    // Block number of first free map block
+  uint groupstart;   // Block number of first block group
+  uint ngroups;      // Number of block groups
+  uint bpg;          // Blocks per group (at most BPB)
+  uint ipg;          // Inodes per group (a multiple of IPB)
+  uint swapstart;    // Block number of first swap block
+  uint nswap;        // Number of swap blocks
 };
 
 #define NDIRECT 12
@@ -43,14 +53,19 @@ struct dinode {
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
+// First block of group g
+#define GSTART(g, sb)     ((sb).groupstart + (g) * (sb).bpg)
+
 // Block containing inode i
-#define IBLOCK(i, sb)     ((i) / IPB + sb.inodestart)
+#define IBLOCK(i, sb)     (GSTART((i) / (sb).ipg, sb) + 1 + (i) % (sb).ipg / IPB)
 
 // Bitmap bits per block
 #define BPB           (BSIZE*8)
 
-// Block of free map containing bit for block b
-#define BBLOCK(b, sb) (b/BPB + sb.bmapstart)
+// Group of block b, the free map block with its bit, and the bit
+#define BGROUP(b, sb)     (((b) - (sb).groupstart) / (sb).bpg)
+#define BBLOCK(b, sb)     GSTART(BGROUP(b, sb), sb)
+#define BINDEX(b, sb)     (((b) - (sb).groupstart) % (sb).bpg)
 
 // Directory is a file containing a sequence of dirent structures.
 #define DIRSIZ 14
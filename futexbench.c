@@ -0,0 +1,169 @@
+// Handoff latency benchmark. Two processes pass a turn back and
+// forth NROUND times, first through a pair of pipes and then
+// through a futex in a page they share (a MAP_SHARED mapping of a
+// scratch file), and the benchmark reports the time per round trip
+// of each. Then NWORKER processes take turns at a mutex and wait on
+// a condition variable in the same page, as a stressfs-style
+// harness would, and the benchmark reports the rate of handoffs.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+#define NROUND  2000
+#define NWORKER 4
+#define NHAND   2000
+
+struct shared {
+  volatile int turn;
+  struct mutex lock;
+  struct cond changed;
+  int next;        // worker whose turn it is, under lock
+  int count;       // handoffs so far, under lock
+};
+
+char *path = "futexbench.tmp";
+char page[4096];
+
+void
+fail(char *what)
+{
+  printf(1, "futexbench: %s failed\n", what);
+  exit();
+}
+
+uint
+elapsed(uint64 *t0)
+{
+  uint64 t1;
+
+  nsuptime(&t1);
+  return (uint)(t1 - *t0);
+}
+
+uint
+pipes(void)
+{
+  int i, ping[2], pong[2];
+  char c;
+  uint64 t0;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0)
+    fail("pipe");
+  if(fork() == 0){
+    for(i = 0; i < NROUND; i++){
+      read(ping[0], &c, 1);
+      write(pong[1], &c, 1);
+    }
+    exit();
+  }
+  nsuptime(&t0);
+  for(i = 0; i < NROUND; i++){
+    write(ping[1], "x", 1);
+    read(pong[0], &c, 1);
+  }
+  wait();
+  close(ping[0]); close(ping[1]);
+  close(pong[0]); close(pong[1]);
+  return elapsed(&t0);
+}
+
+uint
+futexes(struct shared *s)
+{
+  int i;
+  uint64 t0;
+
+  s->turn = 0;
+  if(fork() == 0){
+    for(i = 0; i < NROUND; i++){
+      while(s->turn == 0)
+        futex_wait(&s->turn, 0);
+      s->turn = 0;
+      futex_wake(&s->turn, 1);
+    }
+    exit();
+  }
+  nsuptime(&t0);
+  for(i = 0; i < NROUND; i++){
+    s->turn = 1;
+    futex_wake(&s->turn, 1);
+    while(s->turn == 1)
+      futex_wait(&s->turn, 1);
+  }
+  wait();
+  return elapsed(&t0);
+}
+
+void
+worker(struct shared *s, int me)
+{
+  mutex_lock(&s->lock);
+  while(s->count < NHAND){
+    if(s->next != me){
+      cond_wait(&s->changed, &s->lock);
+      continue;
+    }
+    s->count++;
+    s->next = (me + 1) % NWORKER;
+    cond_broadcast(&s->changed);
+  }
+  mutex_unlock(&s->lock);
+  exit();
+}
+
+uint
+handoffs(struct shared *s)
+{
+  int i;
+  uint64 t0;
+
+  mutex_init(&s->lock);
+  cond_init(&s->changed);
+  s->next = 0;
+  s->count = 0;
+  nsuptime(&t0);
+  for(i = 0; i < NWORKER; i++)
+    if(fork() == 0)
+      worker(s, i);
+  for(i = 0; i < NWORKER; i++)
+    wait();
+  if(s->count != NHAND)
+    fail("mutex handoff count");
+  return elapsed(&t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct shared *s;
+  uint t;
+  int fd;
+
+  if((fd = open(path, O_CREATE|O_RDWR)) < 0 ||
+     write(fd, page, sizeof(page)) != sizeof(page))
+    fail("create");
+  s = mmap(0, sizeof(page), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(s == MAP_FAILED)
+    fail("mmap");
+  s->turn = 0;     // fault the page in before forking
+
+  printf(1, "futexbench: %d CPUs, %d round trips\n", kstat(KS_NCPU),
+         NROUND);
+  t = pipes();
+  printf(1, "futexbench: pipe handoff: %d ns per round trip\n",
+         t / NROUND);
+  t = futexes(s);
+  printf(1, "futexbench: futex handoff: %d ns per round trip\n",
+         t / NROUND);
+  t = handoffs(s);
+  printf(1, "futexbench: mutex/cond, %d workers: %d ns per handoff\n",
+         NWORKER, t / NHAND);
+
+  munmap(s, sizeof(page));
+  close(fd);
+  unlink(path);
+  exit();
+}
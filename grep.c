@@ -3,29 +3,47 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "fcntl.h"
 
 char buf[1024];
-int match(char*, char*);
+int match(char*, char*, char*);
+
+// Print the lines in [p, end) that match pattern.
+// Returns a pointer just past the last complete line.
+char*
+grepbuf(char *pattern, char *p, char *end)
+{
+  char *q;
+
+  for(q = p; q < end; q++){
+    if(*q == '\n'){
+      if(match(pattern, p, q))
+        fwrite(sout, p, q+1 - p);
+      p = q+1;
+    }
+  }
+  return p;
+}
 
 void
 grep(char *pattern, int fd)
 {
+  struct stat st;
   int n, m;
-  char *p, *q;
+  char *p;
+
+  if(fstat(fd, &st) == 0 && st.type == T_FILE && st.size > 0 &&
+     (p = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED){
+    // Search the file in place instead of copying it out with read().
+    grepbuf(pattern, p, p + st.size);
+    munmap(p, st.size);
+    return;
+  }
 
   m = 0;
-  while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
+  while((n = read(fd, buf+m, sizeof(buf)-m)) > 0){
     m += n;
-    buf[m] = '\0';
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
-      *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
-      }
-      p = q+1;
-    }
+    p = grepbuf(pattern, buf, buf+m);
     if(p == buf)
       m = 0;
     if(m > 0){
@@ -54,7 +72,7 @@ main(int argc, char *argv[])
 
   for(i = 2; i < argc; i++){
     if((fd = open(argv[i], 0)) < 0){
-      printf(1, "grep: cannot open %s\n", argv[i]);
+      fprintf(sout, "grep: cannot open %s\n", argv[i]);
       exit();
     }
     grep(pattern, fd);
@@ -64,44 +82,44 @@ main(int argc, char *argv[])
 }
 
 // Regexp matcher from Kernighan & Pike,
-// The Practice of Programming, Chapter 9.
+// The Practice of Programming, Chapter 9,
+// matching text in [text, end) rather than a C string.
 
-int matchhere(char*, char*);
-int matchstar(int, char*, char*);
+int matchhere(char*, char*, char*);
+int matchstar(int, char*, char*, char*);
 
 int
-match(char *re, char *text)
+match(char *re, char *text, char *end)
 {
   if(re[0] == '^')
-    return matchhere(re+1, text);
+    return matchhere(re+1, text, end);
   do{  // must look at empty string
-    if(matchhere(re, text))
+    if(matchhere(re, text, end))
       return 1;
-  }while(*text++ != '\0');
+  }while(text++ < end);
   return 0;
 }
 
 // matchhere: search for re at beginning of text
-int matchhere(char *re, char *text)
+int matchhere(char *re, char *text, char *end)
 {
   if(re[0] == '\0')
     return 1;
   if(re[1] == '*')
-    return matchstar(re[0], re+2, text);
+    return matchstar(re[0], re+2, text, end);
   if(re[0] == '$' && re[1] == '\0')
-    return *text == '\0';
-  if(*text!='\0' && (re[0]=='.' || re[0]==*text))
-    return matchhere(re+1, text+1);
+    return text == end;
+  if(text < end && (re[0]=='.' || re[0]==*text))
+    return matchhere(re+1, text+1, end);
   return 0;
 }
 
 // matchstar: search for c*re at beginning of text
-int matchstar(int c, char *re, char *text)
+int matchstar(int c, char *re, char *text, char *end)
 {
   do{  // a * matches zero or more instances
-    if(matchhere(re, text))
+    if(matchhere(re, text, end))
       return 1;
-  }while(*text!='\0' && (*text++==c || c=='.'));
+  }while(text < end && (*text++==c || c=='.'));
   return 0;
 }
-
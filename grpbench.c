@@ -0,0 +1,108 @@
+// Block group benchmark. 1, 2 and 4 processes each make a directory
+// and create NFILE files of FILESIZE bytes in it, all at once.
+// Reports the files created per second, and the disk requests made
+// with the mean distance in blocks from each to the one before: the
+// seeks a real disk would make between inodes, free maps and data.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+#define NFILE    50
+#define FILESIZE 1024
+
+char buf[FILESIZE];
+
+void
+mkpath(char *path, int p, int f)
+{
+  strcpy(path, "grp0/f00");
+  path[3] = '0' + p;
+  if(f < 0)
+    path[4] = 0;
+  else {
+    path[6] = '0' + f/10;
+    path[7] = '0' + f%10;
+  }
+}
+
+void
+child(int p)
+{
+  char path[16];
+  int f, fd;
+
+  mkpath(path, p, -1);
+  if(mkdir(path) < 0){
+    printf(1, "grpbench: cannot make %s\n", path);
+    exit();
+  }
+  for(f = 0; f < NFILE; f++){
+    mkpath(path, p, f);
+    if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+      printf(1, "grpbench: cannot create %s\n", path);
+      exit();
+    }
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      printf(1, "grpbench: write %s failed\n", path);
+    close(fd);
+  }
+  exit();
+}
+
+void
+cleanup(int nproc)
+{
+  char path[16];
+  int p, f;
+
+  for(p = 0; p < nproc; p++){
+    for(f = 0; f < NFILE; f++){
+      mkpath(path, p, f);
+      unlink(path);
+    }
+    mkpath(path, p, -1);
+    unlink(path);
+  }
+}
+
+void
+run(int nproc)
+{
+  int p, io, seek;
+  uint64 t0, t1;
+  uint ms;
+
+  io = kstat(KS_DISKIO);
+  seek = kstat(KS_DISKSEEK);
+  nsuptime(&t0);
+  for(p = 0; p < nproc; p++)
+    if(fork() == 0)
+      child(p);
+  for(p = 0; p < nproc; p++)
+    wait();
+  nsuptime(&t1);
+  ms = (uint)(t1 - t0) / 1000000;
+  if(ms == 0)
+    ms = 1;
+  io = kstat(KS_DISKIO) - io;
+  seek = kstat(KS_DISKSEEK) - seek;
+  printf(1, "grpbench: %d procs: %d creates/s, %d disk requests, "
+         "%d blocks per seek\n", nproc, nproc * NFILE * 1000 / ms,
+         io, io ? seek / io : 0);
+  cleanup(nproc);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  memset(buf, 'g', sizeof(buf));
+  printf(1, "grpbench: %d CPUs\n", kstat(KS_NCPU));
+  for(n = 1; n <= 4; n *= 2)
+    run(n);
+  exit();
+}
@@ -12,6 +12,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "kstat.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -32,6 +33,7 @@ static struct spinlock idelock;
 static struct buf *idequeue;
 
 static int havedisk1;
+static uint lastblock;   // block of the last request, for KS_DISKSEEK
 static void idestart(struct buf*);
 
 // Wait for IDE disk to become ready.
@@ -75,7 +77,7 @@ idestart(struct buf *b)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno >= FSSIZE+SWAPSIZE)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
@@ -84,6 +86,13 @@ idestart(struct buf *b)
 
   if (sector_per_block > 7) panic("idestart");
 
+  kstats[KS_DISKIO]++;
+  if(b->blockno > lastblock)
+    kstats[KS_DISKSEEK] += b->blockno - lastblock;
+  else
+    kstats[KS_DISKSEEK] += lastblock - b->blockno;
+  lastblock = b->blockno;
+
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
   outb(0x1f2, sector_per_block);  // number of sectors
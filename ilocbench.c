@@ -0,0 +1,103 @@
+// Inode locality benchmark. Makes NDIR directories and creates
+// NPER files in them round robin, as several programs writing at
+// once would, then reads each directory and counts the inode
+// blocks its entries live in: the blocks that ls or find must read
+// to stat them. Reports that count per directory against the
+// fewest blocks the entries could fit in.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+
+#define NDIR 4
+#define NPER 16
+
+char path[32];
+
+void
+mkpath(int d, int f)
+{
+  strcpy(path, "iloc/d0/f00");
+  path[6] = '0' + d;
+  if(f < 0)
+    path[7] = 0;
+  else {
+    path[9] = '0' + f/10;
+    path[10] = '0' + f%10;
+  }
+}
+
+// Count the inode blocks holding the entries of the directory
+// at path, other than "..". Sets *n to the number of entries.
+int
+blocks(char *path, int *n)
+{
+  struct dirent de;
+  uint seen[NPER+2];
+  int fd, i, nseen;
+
+  if((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  nseen = *n = 0;
+  while(read(fd, &de, sizeof(de)) == sizeof(de)){
+    if(de.inum == 0 || strcmp(de.name, "..") == 0)
+      continue;
+    (*n)++;
+    for(i = 0; i < nseen; i++)
+      if(seen[i] == de.inum / IPB)
+        break;
+    if(i == nseen && nseen < NPER+2)
+      seen[nseen++] = de.inum / IPB;
+  }
+  close(fd);
+  return nseen;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int d, f, fd, n, b, total, best;
+
+  if(mkdir("iloc") < 0){
+    printf(1, "ilocbench: cannot make iloc\n");
+    exit();
+  }
+  for(d = 0; d < NDIR; d++){
+    mkpath(d, -1);
+    mkdir(path);
+  }
+  for(f = 0; f < NPER; f++){
+    for(d = 0; d < NDIR; d++){
+      mkpath(d, f);
+      if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+        printf(1, "ilocbench: cannot create %s\n", path);
+        exit();
+      }
+      close(fd);
+    }
+  }
+
+  total = best = 0;
+  for(d = 0; d < NDIR; d++){
+    mkpath(d, -1);
+    b = blocks(path, &n);
+    printf(1, "ilocbench: %s: %d entries in %d inode blocks\n", path, n, b);
+    total += b;
+    best += (n + IPB - 1) / IPB;
+  }
+  printf(1, "ilocbench: %d inode blocks per listing, %d at best\n",
+         total / NDIR, best / NDIR);
+
+  for(d = 0; d < NDIR; d++){
+    for(f = 0; f < NPER; f++){
+      mkpath(d, f);
+      unlink(path);
+    }
+    mkpath(d, -1);
+    unlink(path);
+  }
+  unlink("iloc");
+  exit();
+}
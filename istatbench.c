@@ -0,0 +1,90 @@
+// Inode cache benchmark. Makes a tree of NDIR directories of NPER
+// files each, then stat()s the files round robin, NSTAT times in
+// all, so that every lookup walks a path of three inodes that
+// have no other references between calls. Reports the stats per
+// second and the inode cache hits, misses and entries made.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+#define NDIR   8
+#define NPER   12
+#define NSTAT  30000
+
+char path[32];
+
+void
+mkpath(int d, int f)
+{
+  strcpy(path, "istat/d0/f00");
+  path[7] = '0' + d;
+  if(f < 0)
+    path[8] = 0;
+  else {
+    path[10] = '0' + f/10;
+    path[11] = '0' + f%10;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int d, f, i, fd, hit, miss, made;
+  uint64 t0, t1;
+  struct stat st;
+  uint ms;
+
+  if(mkdir("istat") < 0){
+    printf(1, "istatbench: cannot make istat\n");
+    exit();
+  }
+  for(d = 0; d < NDIR; d++){
+    mkpath(d, -1);
+    mkdir(path);
+    for(f = 0; f < NPER; f++){
+      mkpath(d, f);
+      if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+        printf(1, "istatbench: cannot create %s\n", path);
+        exit();
+      }
+      close(fd);
+    }
+  }
+
+  hit = kstat(KS_ICHIT);
+  miss = kstat(KS_ICMISS);
+  made = kstat(KS_ICINODES);
+  nsuptime(&t0);
+  for(i = 0; i < NSTAT; i++){
+    mkpath(i % NDIR, i / NDIR % NPER);
+    if(stat(path, &st) < 0){
+      printf(1, "istatbench: stat %s failed\n", path);
+      exit();
+    }
+  }
+  nsuptime(&t1);
+  ms = (uint)(t1 - t0) / 1000000;
+  if(ms == 0)
+    ms = 1;
+  hit = kstat(KS_ICHIT) - hit;
+  miss = kstat(KS_ICMISS) - miss;
+  printf(1, "istatbench: %d stats of %d files in %d ms, %d stats/s\n",
+         NSTAT, NDIR*NPER, ms, NSTAT * 1000 / ms);
+  printf(1, "istatbench: inode cache: %d hits, %d misses, "
+         "%d entries made (%d in all)\n", hit, miss,
+         kstat(KS_ICINODES) - made, kstat(KS_ICINODES));
+
+  for(d = 0; d < NDIR; d++){
+    for(f = 0; f < NPER; f++){
+      mkpath(d, f);
+      unlink(path);
+    }
+    mkpath(d, -1);
+    unlink(path);
+  }
+  unlink("istat");
+  exit();
+}
@@ -1,6 +1,12 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// It also hands out 4MB pages for processes that ask for a
+// huge-page heap (see allochugeuvm() in vm.c), by taking an
+// aligned 4MB run whose 4KB pages are all free off the free list.
+// Nothing is set aside for them, so they run out once free memory
+// is fragmented; the heap then uses 4KB pages.
 
 #include "types.h"
 #include "defs.h"
@@ -8,6 +14,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "kstat.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -21,6 +28,9 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  // Reference count of every physical page, so that a page can be
+  // mapped by several page tables (e.g. shared text from pcache.c).
+  ushort ref[PHYSTOP/PGSIZE];
 } kmem;
 
 // Initialization happens in two phases.
@@ -56,6 +66,8 @@ freerange(void *vstart, void *vend)
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// Pages with more than one reference are not freed; the
+// reference count is just decremented.
 void
 kfree(char *v)
 {
@@ -64,6 +76,18 @@ kfree(char *v)
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] > 1){
+    kmem.ref[V2P(v)/PGSIZE]--;
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  kmem.ref[V2P(v)/PGSIZE] = 0;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
@@ -72,6 +96,7 @@ kfree(char *v)
   r = (struct run*)v;
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kstats[KS_FREEPAGES]++;
   if(kmem.use_lock)
     release(&kmem.lock);
 }
@@ -87,10 +112,84 @@ kalloc(void)
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.ref[V2P(r)/PGSIZE] = 1;
+    kstats[KS_FREEPAGES]--;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
   return (char*)r;
 }
 
+// Add a reference to the page at v, which must have
+// been returned by kalloc().
+void
+kref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kref");
+
+  acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] < 1)
+    panic("kref: free page");
+  kmem.ref[V2P(v)/PGSIZE]++;
+  release(&kmem.lock);
+}
+
+// Return the number of references to the page at v.
+int
+krefcount(char *v)
+{
+  return kmem.ref[V2P(v)/PGSIZE];
+}
+
+
+// Free a 4MB page returned by khugealloc(): its 4KB
+// pages go back on the free list.
+void
+khugefree(char *v)
+{
+  char *p;
+
+  if((uint)v % HUGEPGSIZE || V2P(v) >= PHYSTOP)
+    panic("khugefree");
+  for(p = v; p < v + HUGEPGSIZE; p += PGSIZE)
+    kfree(p);
+  __sync_fetch_and_sub(&kstats[KS_HUGEPAGES], 1);
+}
+
+// Allocate one 4MB page, made of an aligned run of free 4KB
+// pages, or return 0 if there is none. The free list is walked
+// twice under the lock: once to count the free pages in each
+// 4MB run, and once to take the pages of the highest full run,
+// away from the kernel's own data at the bottom.
+char*
+khugealloc(void)
+{
+  ushort nfree[PHYSTOP/HUGEPGSIZE];
+  struct run *r, **rp;
+  int h;
+
+  memset(nfree, 0, sizeof(nfree));
+  acquire(&kmem.lock);
+  for(r = kmem.freelist; r; r = r->next)
+    nfree[V2P(r)/HUGEPGSIZE]++;
+  for(h = PHYSTOP/HUGEPGSIZE - 1; h >= 0; h--)
+    if(nfree[h] == HUGEPGSIZE/PGSIZE)
+      break;
+  if(h < 0){
+    release(&kmem.lock);
+    return 0;
+  }
+  for(rp = &kmem.freelist; *rp; ){
+    if(V2P(*rp)/HUGEPGSIZE == h)
+      *rp = (*rp)->next;
+    else
+      rp = &(*rp)->next;
+  }
+  kstats[KS_FREEPAGES] -= HUGEPGSIZE/PGSIZE;
+  release(&kmem.lock);
+  kstatinc(KS_HUGEPAGES);
+  return (char*)P2V(h * HUGEPGSIZE);
+}
@@ -0,0 +1,32 @@
+// Kernel statistics, read from user space with kstat(n).
+// Both the kernel and user programs use this header file.
+
+#define KS_FREEPAGES   0   // free physical pages
+#define KS_PCHIT       1   // page cache lookups that found the page
+#define KS_PCMISS      2   // page cache lookups that read the file
+#define KS_PCPAGES     3   // pages held by the page cache
+#define KS_MMAPFAULT   4   // page faults on mmap()ed files
+#define KS_HUGEPAGES   5   // 4MB pages in use
+#define KS_CR3LOAD     6   // writes to cr3 (each flushes the TLB)
+#define KS_CSWITCH     7   // switches from the scheduler to a process
+#define KS_PAGEIN      8   // pages read back from swap
+#define KS_PAGEOUT     9   // pages written out to swap
+#define KS_PAGEINKCYC 10   // TSC cycles/1024 spent in page-in faults
+#define KS_SWAPFREE   11   // free swap slots
+#define KS_NCPU       12   // number of CPUs
+#define KS_STEAL      13   // processes taken from another CPU's run queue
+#define KS_WAKEUP     14   // calls to wakeup()
+#define KS_WAKEUPSCAN 15   // sleeping processes wakeup() looked at
+#define KS_TIMERINT   16   // LAPIC timer interrupts
+#define KS_IDLEWAKE   17   // times an idle CPU woke from hlt
+#define KS_SLEEPLOCKSPIN  18  // held sleep locks got by spinning
+#define KS_SLEEPLOCKSLEEP 19  // sleep lock acquisitions that slept
+#define KS_TLBSHOOT   20   // TLB shootdown IPIs sent
+#define KS_SYSCALL    21   // system calls made (counted per CPU)
+#define KS_ICHIT      22   // inode cache lookups that found the inode
+#define KS_ICMISS     23   // inode cache lookups that took a new entry
+#define KS_ICINODES   24   // inode cache entries made
+#define KS_DISKIO     25   // disk requests started
+#define KS_DISKSEEK   26   // blocks between each disk request and the last
+
+#define NKSTAT        27
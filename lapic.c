@@ -60,13 +60,12 @@ lapicinit(void)
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-  // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The timer counts down once at bus frequency from
+  // lapic[TICR] and then issues an interrupt. It stays off
+  // until timerarm() (see timer.c) has a deadline for it.
   lapicw(TDCR, X1);
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+  lapicw(TICR, 0);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -113,6 +112,35 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Start the timer counting down from count; 0 stops it.
+void
+lapictimer(uint count)
+{
+  if(lapic)
+    lapicw(TICR, count);
+}
+
+// Current count of the timer.
+uint
+lapictimercount(void)
+{
+  if(!lapic)
+    return 0;
+  return lapic[TCCR];
+}
+
+// Send interrupt vector vec to the CPU with the given APIC ID.
+void
+lapicipi(int apicid, int vec)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vec);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
@@ -0,0 +1,89 @@
+// Lock contention benchmark. 1, 2, 4 and 8 processes hammer hot
+// kernel locks at once, each in a loop of
+//   kill() of a pid that does not exist  (ptable.lock)
+//   sbrk() of a page and back             (kmem)
+//   dup() and close()                     (ftable)
+// and the benchmark reports the loops per second and, for each of
+// those locks, how many acquisitions had to wait and for how long.
+// Boot with CPUS=8 to see contention across 8 CPUs.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+#include "lockstat.h"
+
+#define RUNTICKS 200
+#define HZ       100   // timer ticks per second
+
+char *names[] = { "ptable", "kmem", "ftable" };
+#define NNAME (sizeof(names)/sizeof(names[0]))
+
+struct lockstat before[NNAME], after[NNAME];
+
+void
+snapshot(struct lockstat *ls)
+{
+  struct lockstat s;
+  int i, n;
+
+  memset(ls, 0, NNAME*sizeof(*ls));
+  for(n = 0; lockstat(n, &s) == 0; n++)
+    for(i = 0; i < NNAME; i++)
+      if(strcmp(s.name, names[i]) == 0)
+        ls[i] = s;
+}
+
+void
+run(int nproc)
+{
+  int i, j, n, fd[2], t0;
+  uint acq, con, cyc;
+
+  pipe(fd);
+  snapshot(before);
+  t0 = uptime();
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0){
+      close(fd[0]);
+      for(n = 0; uptime() - t0 < RUNTICKS; n++){
+        kill(1000000);
+        sbrk(4096);
+        sbrk(-4096);
+        close(dup(fd[1]));
+      }
+      write(fd[1], &n, sizeof(n));
+      exit();
+    }
+  }
+  close(fd[1]);
+  j = 0;
+  for(i = 0; i < nproc; i++){
+    if(read(fd[0], &n, sizeof(n)) == sizeof(n))
+      j += n;
+    wait();
+  }
+  close(fd[0]);
+  snapshot(after);
+
+  printf(1, "lockbench: %d procs: %d loops/s\n", nproc, j * HZ / RUNTICKS);
+  for(i = 0; i < NNAME; i++){
+    acq = after[i].nacquire - before[i].nacquire;
+    con = after[i].ncontend - before[i].ncontend;
+    cyc = after[i].spincycles - before[i].spincycles;
+    printf(1, "lockbench:   %s: %d acquires, %d contended, "
+           "%d cycles per contended acquire\n",
+           names[i], acq, con, con ? cyc / con : 0);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  printf(1, "lockbench: %d CPUs\n", kstat(KS_NCPU));
+  for(n = 1; n <= 8; n *= 2)
+    run(n);
+  exit();
+}
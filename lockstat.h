@@ -0,0 +1,11 @@
+// Spin lock statistics, read from user space with lockstat(n, &ls).
+// Locks with the same name are added up.
+// Both the kernel and user programs use this header file.
+
+struct lockstat {
+  char name[16];
+  uint nlock;          // locks with this name
+  uint nacquire;       // acquisitions
+  uint ncontend;       // acquisitions that had to wait
+  uint64 spincycles;   // TSC cycles spent waiting
+};
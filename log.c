@@ -21,34 +21,58 @@
 // sleeps until the last outstanding end_op() commits.
 //
 // The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
+// It is split into two halves, each laid out as:
 //   header block, containing block #s for block A, B, C, ...
 //   block A
 //   block B
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// A transaction commits into one half, and the next one can start
+// in the other half as soon as the commit's header is on disk. The
+// writeback daemon, logdaemon(), installs committed transactions
+// to their home locations in the background, oldest first and in
+// block order, then erases the header and frees the half. Recovery
+// replays the halves that were not erased, in the order of their
+// sequence numbers. logwriteback(0) turns the daemon off, and commit()
+// then installs as the original did.
+//
+// A committed block stays pinned in the buffer cache until it is
+// installed. If no later transaction has logged it, the cached
+// copy is what was committed and is written out; otherwise it is
+// written from the log, through wbuf, leaving the cache alone.
+
+#define LOGBLOCKS (LOGSIZE/2)   // most blocks in a half
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  uint seq;      // order of commits, for recovery
+  int block[LOGBLOCKS];
 };
 
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int size;        // blocks in each half, with its header
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
   int dev;
-  struct logheader lh;
+  int cur;         // half the current transaction will commit into
+  uint seq;        // sequence number of the next commit
+  int busy[2];     // half holds a commit not yet installed
+  int sync;        // commit() installs, not the daemon
+  struct logheader lh;       // the current transaction
+  struct logheader done[2];  // commits waiting to be installed
 };
 struct log log;
+static struct buf wbuf;   // for writing blocks from the log
 
 static void recover_from_log(void);
 static void commit();
+static void logdaemon(void);
 
 void
 initlog(int dev)
@@ -58,67 +82,173 @@ initlog(int dev)
 
   struct superblock sb;
   initlock(&log.lock, "log");
+  initsleeplock(&wbuf.lock, "wbuf");
   readsb(dev, &sb);
   log.start = sb.logstart;
-  log.size = sb.nlog;
+  log.size = sb.nlog / 2;
+  if(log.size - 1 > LOGBLOCKS)
+    log.size = LOGBLOCKS + 1;
   log.dev = dev;
   recover_from_log();
+  kthread("logd", logdaemon);
 }
 
-// Copy committed blocks from log to their home location
+// Is block b in a transaction after lh: the current one, or the
+// other half's, if that is waiting to be installed and is newer?
+static int
+logged_later(struct logheader *lh, int b)
+{
+  struct logheader *o;
+  int h, i, r;
+
+  r = 0;
+  acquire(&log.lock);
+  for(i = 0; i < log.lh.n; i++)
+    if(log.lh.block[i] == b)
+      r = 1;
+  for(h = 0; h < 2; h++){
+    o = &log.done[h];
+    if(log.busy[h] && o != lh && (int)(o->seq - lh->seq) > 0)
+      for(i = 0; i < o->n; i++)
+        if(o->block[i] == b)
+          r = 1;
+  }
+  release(&log.lock);
+  return r;
+}
+
+// Copy the blocks committed in half h (as lh says) from the log to
+// their home locations, in block order.
 static void
-install_trans(void)
+install_trans(int h, struct logheader *lh, int recovering)
 {
-  int tail;
+  int i, k, t, order[LOGBLOCKS];
+  struct buf *lbuf, *dbuf;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
+  for(k = 0; k < lh->n; k++){
+    t = k;
+    for(i = k; i > 0 && lh->block[order[i-1]] > lh->block[t]; i--)
+      order[i] = order[i-1];
+    order[i] = t;
+  }
+
+  for(k = 0; k < lh->n; k++){
+    i = order[k];
+    dbuf = bread(log.dev, lh->block[i]); // read dst
+    if(recovering){
+      lbuf = bread(log.dev, log.start+h*log.size+i+1); // read log block
+      memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
+      brelse(lbuf);
+      bwrite(dbuf);  // write dst to disk
+    } else if(!logged_later(lh, lh->block[i])){
+      bwrite(dbuf);  // the cached copy is the committed one
+    } else {
+      lbuf = bread(log.dev, log.start+h*log.size+i+1);
+      acquiresleep(&wbuf.lock);
+      wbuf.dev = log.dev;
+      wbuf.blockno = lh->block[i];
+      memmove(wbuf.data, lbuf->data, BSIZE);
+      wbuf.flags = B_DIRTY;
+      iderw(&wbuf);
+      releasesleep(&wbuf.lock);
+      brelse(lbuf);
+    }
     brelse(dbuf);
   }
 }
 
-// Read the log header from disk into the in-memory log header
+// Read the log header of half h from disk into lh
 static void
-read_head(void)
+read_head(int h, struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
-  }
+  struct buf *buf = bread(log.dev, log.start+h*log.size);
+  memmove(lh, buf->data, sizeof(*lh));
   brelse(buf);
+  if(lh->n < 0 || lh->n > log.size - 1)
+    lh->n = 0;
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Write lh to disk as the header of half h.
+// This is the true point at which a transaction commits.
 static void
-write_head(void)
+write_head(int h, struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
-  int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
-  }
+  struct buf *buf = bread(log.dev, log.start+h*log.size);
+  memmove(buf->data, lh, sizeof(*lh));
   bwrite(buf);
   brelse(buf);
 }
 
+// Erase the transaction in half h from the log.
+static void
+erase_head(int h)
+{
+  struct logheader lh;
+
+  memset(&lh, 0, sizeof(lh));
+  write_head(h, &lh);
+}
+
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct logheader lh[2];
+  int h;
+
+  read_head(0, &lh[0]);
+  read_head(1, &lh[1]);
+  // if committed, copy from log to disk, older first
+  h = lh[0].n && lh[1].n && (int)(lh[1].seq - lh[0].seq) < 0;
+  install_trans(h, &lh[h], 1);
+  install_trans(!h, &lh[!h], 1);
+  if(lh[!h].n)
+    log.seq = lh[!h].seq + 1;
+  else if(lh[h].n)
+    log.seq = lh[h].seq + 1;
+  erase_head(0); // clear the log
+  erase_head(1);
+}
+
+// The writeback daemon. Installs each committed transaction,
+// oldest first, and then frees its half of the log.
+static void
+logdaemon(void)
+{
+  struct logheader lh;
+  int h;
+
+  acquire(&log.lock);
+  for(;;){
+    h = log.busy[0] && (!log.busy[1] ||
+                        (int)(log.done[1].seq - log.done[0].seq) > 0) ? 0 : 1;
+    if(!log.busy[h]){
+      sleep(&log.done, &log.lock);
+      continue;
+    }
+    lh = log.done[h];
+    release(&log.lock);
+
+    install_trans(h, &lh, 0);
+    erase_head(h);
+
+    acquire(&log.lock);
+    log.busy[h] = 0;
+    wakeup(&log);
+  }
+}
+
+// Turn the writeback daemon on or off.
+// Returns the old setting.
+int
+logwriteback(int on)
+{
+  int old;
+
+  acquire(&log.lock);
+  old = !log.sync;
+  log.sync = !on;
+  release(&log.lock);
+  return old;
 }
 
 // called at the start of each FS system call.
@@ -127,9 +257,9 @@ begin_op(void)
 {
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.committing || log.busy[log.cur]){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > log.size - 1){
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log.lock);
     } else {
@@ -173,14 +303,14 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy modified blocks from cache to half h of the log.
 static void
-write_log(void)
+write_log(int h)
 {
   int tail;
 
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
+    struct buf *to = bread(log.dev, log.start+h*log.size+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
     bwrite(to);  // write the log
@@ -192,13 +322,35 @@ write_log(void)
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
+  struct logheader lh;
+  int h = log.cur;
+
+  if (log.lh.n == 0)
+    return;
+  log.lh.seq = log.seq++;
+  write_log(h);              // Write modified blocks from cache to log
+  write_head(h, &log.lh);    // Write header to disk -- the real commit
+
+  acquire(&log.lock);
+  if(!log.sync){
+    // Leave the install to the daemon, and start
+    // the next transaction in the other half.
+    log.done[h] = log.lh;
+    log.busy[h] = 1;
+    log.cur = !h;
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    wakeup(&log.done);
+    release(&log.lock);
+    return;
   }
+  // Install it here, after any older commit.
+  while(log.busy[!h])
+    sleep(&log, &log.lock);
+  lh = log.lh;
+  log.lh.n = 0;
+  release(&log.lock);
+  install_trans(h, &lh, 0);  // Now install writes to home locations
+  erase_head(h);             // Erase the transaction from the log
 }
 
 // Caller has modified b->data and is done with the buffer.
@@ -215,7 +367,7 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= LOGBLOCKS || log.lh.n >= log.size - 1)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -21,6 +21,7 @@ main(void)
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
+  timerinit();     // calibrate clock and timers
   seginit();       // segment descriptors
   picinit();       // disable pic
   ioapicinit();    // another interrupt controller
@@ -29,6 +30,7 @@ main(void)
   pinit();         // process table
   tvinit();        // trap vectors
   binit();         // buffer cache
+  pcacheinit();    // page cache
   fileinit();      // file table
   ideinit();       // disk 
   startothers();   // start other processors
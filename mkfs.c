@@ -4,41 +4,70 @@
 #include <string.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #define stat xv6_stat  // avoid clash with host struct stat
 #include "types.h"
 #include "fs.h"
 #include "stat.h"
 #include "param.h"
+#undef stat
+#include <sys/stat.h>
 
 #ifndef static_assert
 #define static_assert(a, b) do { switch (0) case 0: case (a): ; } while (0)
 #endif
 
-#define NINODES 200
+#define IPG     128   // inodes per block group, unless -i says
+#define BPG     BPB   // blocks per block group
+#define NTHREAD 4     // file import threads, unless -j says
+#define NTAG    (BSIZE / 40)   // tags in a tags block (see fs_ftag())
 
 // Disk layout:
-// [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
-
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
-int ninodeblocks = NINODES / IPB + 1;
+// [ boot block | sb block | log | group 0 | group 1 | ... ]
+// and each group is
+// [ free bit map block | inode blocks | data blocks ]
+//
+// The image is built in memory and written out with a few large
+// writes at the end. Files are imported in two passes: the first
+// allocates each file's inode and blocks, knowing its size, and the
+// second has NTHREAD threads read the files' contents straight into
+// their blocks.
+
+int ngroups = (FSSIZE - 2 - LOGSIZE + BPG - 1) / BPG;
+int ipg = IPG;
+int ninodeblocks;   // per group
 int nlog = LOGSIZE;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
 int fsfd;
 struct superblock sb;
-char zeroes[BSIZE];
+uchar *img;   // the file system, FSSIZE blocks
 uint freeinode = 1;
 uint freeblock;
 
+// Host files whose contents go in the image.
+struct job {
+  char *path;
+  uint inum;
+};
+struct job *jobs;
+int njob, maxjob;
+int nextjob;
+
+// Directories made so far, by path, to find parents.
+#define NDIRHASH 65536
+struct {
+  char *path;
+  uint inum;
+} dirs[NDIRHASH];
 
 void balloc(int);
-void wsect(uint, void*);
-void winode(uint, struct dinode*);
-void rinode(uint inum, struct dinode *ip);
-void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
+uint newblock(void);
 void iappend(uint inum, void *p, int n);
 
 // convert to intel byte order
@@ -64,192 +93,493 @@ xint(uint x)
   return y;
 }
 
+uchar*
+block(uint b)
+{
+  assert(b < FSSIZE);
+  return img + b*BSIZE;
+}
+
+struct dinode*
+dinode(uint inum)
+{
+  return (struct dinode*)block(IBLOCK(inum, sb)) + inum%IPB;
+}
+
+uint
+dirhash(char *path)
+{
+  uint h;
+
+  for(h = 2166136261u; *path; path++)
+    h = (h ^ (uchar)*path) * 16777619u;
+  return h % NDIRHASH;
+}
+
+// Return the slot in dirs for path: its own, or an empty one.
 int
-main(int argc, char *argv[])
+dirslot(char *path)
+{
+  uint h;
+
+  for(h = dirhash(path); dirs[h].path; h = (h + 1) % NDIRHASH)
+    if(strcmp(dirs[h].path, path) == 0)
+      break;
+  return h;
+}
+
+// Add an entry for inum named name to directory dir.
+void
+dirlink(uint dir, char *name, uint inum)
 {
-  int i, cc, fd;
-  uint rootino, inum, off;
   struct dirent de;
-  char buf[BSIZE];
-  struct dinode din;
 
+  bzero(&de, sizeof(de));
+  de.inum = xshort(inum);
+  memmove(de.name, name, strlen(name) < DIRSIZ ? strlen(name) : DIRSIZ);
+  iappend(dir, &de, sizeof(de));
+}
+
+uint mkdirs(char *path);
+
+// Make an inode of type type at path, which is relative to the
+// root, making any directories missing on the way.
+uint
+mkent(char *path, ushort type)
+{
+  char *name, *parent;
+  uint dir, inum;
+  struct dinode *din;
+  int h;
+
+  parent = strdup(path);
+  if((name = strrchr(parent, '/')) != 0){
+    *name++ = 0;
+    dir = mkdirs(parent);
+  } else {
+    name = parent;
+    dir = ROOTINO;
+  }
+  if(strlen(name) > DIRSIZ)
+    fprintf(stderr, "mkfs: %s: name truncated to %d bytes\n", path, DIRSIZ);
+  inum = ialloc(type);
+  dirlink(dir, name, inum);
+  if(type == T_DIR){
+    dirlink(inum, ".", inum);
+    dirlink(inum, "..", dir);
+    din = dinode(dir);
+    din->nlink = xshort(xshort(din->nlink) + 1);   // for ".."
+    h = dirslot(path);
+    dirs[h].path = strdup(path);
+    dirs[h].inum = inum;
+  }
+  free(parent);
+  return inum;
+}
+
+// Return the directory at path, making it if it is missing.
+uint
+mkdirs(char *path)
+{
+  int h;
+
+  if(*path == 0)
+    return ROOTINO;
+  h = dirslot(path);
+  if(dirs[h].path)
+    return dirs[h].inum;
+  return mkent(path, T_DIR);
+}
+
+// Return the block in slot i of the indirect block *addr (both
+// in disk byte order), allocating either if it is not there yet.
+uint
+islot(uint *addr, uint i)
+{
+  uint *indirect;
+
+  if(xint(*addr) == 0)
+    *addr = xint(newblock());
+  indirect = (uint*)block(xint(*addr));
+  if(indirect[i] == 0)
+    indirect[i] = xint(newblock());
+  return xint(indirect[i]);
+}
+
+// Return the block holding block fbn of din's file,
+// allocating it if it is not there yet, as bmap() in fs.c does.
+uint
+bmap(struct dinode *din, uint fbn)
+{
+  uint y;
+
+  assert(fbn < MAXFILE);
+  if(fbn < NDIRECT){
+    if(xint(din->addrs[fbn]) == 0)
+      din->addrs[fbn] = xint(newblock());
+    return xint(din->addrs[fbn]);
+  }
+  fbn -= NDIRECT;
+  if(fbn < NINDIRECT)
+    return islot(&din->addrs[NDIRECT], fbn);
+  fbn -= NINDIRECT;
+  y = xint(islot(&din->addrs[NDIRECT+1], fbn / NINDIRECT));
+  return islot(&y, fbn % NINDIRECT);
+}
+
+// Make a file at path, and queue the host file host to be
+// read into it. Returns its inode number.
+uint
+mkfile(char *path, char *host)
+{
+  struct stat st;
+  struct dinode *din;
+  uint inum, fbn;
+
+  if(stat(host, &st) < 0){
+    perror(host);
+    exit(1);
+  }
+  inum = mkent(path, T_FILE);
+  din = dinode(inum);
+  for(fbn = 0; fbn * BSIZE < st.st_size; fbn++)
+    bmap(din, fbn);
+  din->size = xint(st.st_size);
+  if(njob == maxjob){
+    maxjob = maxjob ? 2*maxjob : 256;
+    jobs = realloc(jobs, maxjob * sizeof(jobs[0]));
+    assert(jobs);
+  }
+  jobs[njob].path = strdup(host);
+  jobs[njob].inum = inum;
+  njob++;
+  return inum;
+}
+
+// Give inode inum the tag key=val, as ftag() would.
+void
+mktag(uint inum, char *key, char *val)
+{
+  struct dinode *din;
+  char *t;
+  uint n;
+
+  din = dinode(inum);
+  n = xint(din->tags_counter);
+  if(strlen(key) > 10 || strlen(val) > 30 || n >= NTAG){
+    fprintf(stderr, "mkfs: tag %s=%s does not fit\n", key, val);
+    exit(1);
+  }
+  if(xint(din->tags) == 0)
+    din->tags = xint(newblock());
+  t = (char*)block(xint(din->tags)) + n*40;
+  memmove(t, key, strlen(key));
+  memmove(t+10, val, strlen(val));
+  din->tags_counter = xint(n + 1);
+}
+
+// Make a symbolic link at path to target, as symlink() would.
+void
+mksymlink(char *path, char *target)
+{
+  struct dinode *din;
+
+  din = dinode(mkent(path, T_SYMLINK));
+  if(strlen(target) >= sizeof(din->addrs)){
+    fprintf(stderr, "mkfs: %s: link target too long\n", path);
+    exit(1);
+  }
+  strcpy((char*)din->addrs, target);
+}
+
+// Read a manifest: one entry per line, paths relative to
+// the root and fields separated by spaces.
+//   d path                          directory
+//   f path hostfile [key=val ...]   file, with its tags
+//   l path target                   symbolic link
+// Missing directories are made, and # starts a comment.
+void
+manifest(char *file)
+{
+  char line[1024], *kind, *path, *arg, *val;
+  uint inum;
+  FILE *fp;
+  int n;
+
+  if((fp = fopen(file, "r")) == 0){
+    perror(file);
+    exit(1);
+  }
+  for(n = 1; fgets(line, sizeof(line), fp); n++){
+    if((kind = strtok(line, " \t\n")) == 0 || *kind == '#')
+      continue;
+    path = strtok(0, " \t\n");
+    arg = strtok(0, " \t\n");
+    if(path == 0 || (*kind != 'd' && arg == 0)){
+      fprintf(stderr, "%s:%d: bad entry\n", file, n);
+      exit(1);
+    }
+    switch(*kind){
+    case 'd':
+      mkdirs(path);
+      break;
+    case 'f':
+      inum = mkfile(path, arg);
+      while((arg = strtok(0, " \t\n")) != 0){
+        if((val = strchr(arg, '=')) == 0){
+          fprintf(stderr, "%s:%d: bad tag %s\n", file, n, arg);
+          exit(1);
+        }
+        *val++ = 0;
+        mktag(inum, arg, val);
+      }
+      break;
+    case 'l':
+      mksymlink(path, arg);
+      break;
+    default:
+      fprintf(stderr, "%s:%d: bad entry\n", file, n);
+      exit(1);
+    }
+  }
+  fclose(fp);
+}
+
+// Read up to n bytes, stopping early only at the end of the file.
+int
+readn(int fd, uchar *p, int n)
+{
+  int cc, tot;
+
+  for(tot = 0; tot < n; tot += cc)
+    if((cc = read(fd, p + tot, n - tot)) <= 0)
+      return cc < 0 ? -1 : tot;
+  return tot;
+}
+
+// Read queued host files into their blocks, a run of
+// consecutive blocks per read().
+void*
+importer(void *arg)
+{
+  struct dinode *din;
+  uint fbn, nfbn, b, run;
+  int i, fd;
+
+  while((i = __sync_fetch_and_add(&nextjob, 1)) < njob){
+    if((fd = open(jobs[i].path, O_RDONLY)) < 0){
+      perror(jobs[i].path);
+      exit(1);
+    }
+    din = dinode(jobs[i].inum);
+    nfbn = (xint(din->size) + BSIZE - 1) / BSIZE;
+    for(fbn = 0; fbn < nfbn; fbn += run){
+      b = bmap(din, fbn);
+      for(run = 1; fbn + run < nfbn && bmap(din, fbn + run) == b + run; run++)
+        ;
+      if(readn(fd, block(b), run * BSIZE) < 0){
+        perror(jobs[i].path);
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+  return 0;
+}
+
+// Write the image to fsfd, and make the file long
+// enough to hold the swap area after it.
+void
+wimage(void)
+{
+  uint off, n;
+  int cc;
+
+  for(off = 0; off < FSSIZE*BSIZE; off += cc){
+    n = FSSIZE*BSIZE - off;
+    if(n > 1024*1024)
+      n = 1024*1024;
+    if((cc = write(fsfd, img + off, n)) <= 0){
+      perror("write");
+      exit(1);
+    }
+  }
+  if(ftruncate(fsfd, (off_t)(FSSIZE + SWAPSIZE) * BSIZE) < 0){
+    perror("ftruncate");
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, c, nthread;
+  uint rootino, off;
+  struct dinode *din;
+  char *man;
+  pthread_t th[64];
+  struct timespec t0, t1;
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
-  if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  man = 0;
+  nthread = NTHREAD;
+  while((c = getopt(argc, argv, "i:j:m:")) != -1){
+    switch(c){
+    case 'i':
+      ipg = atoi(optarg);
+      break;
+    case 'j':
+      nthread = atoi(optarg);
+      break;
+    case 'm':
+      man = optarg;
+      break;
+    default:
+      optind = argc;
+      break;
+    }
+  }
+  if(optind >= argc || nthread < 1 || nthread > 64 ||
+     ipg < IPB || ipg % IPB != 0 || ngroups * ipg > 65536){
+    fprintf(stderr, "Usage: mkfs [-i inodes-per-group] [-j threads] "
+            "[-m manifest] fs.img files...\n");
     exit(1);
   }
-  unsigned long foo =  BSIZE % sizeof(struct dinode);
-    fprintf(stderr, "BSIZE mod DINODE  = %ld, %d, %ld\n", foo, BSIZE, sizeof(struct dinode));
-    
+  argv += optind;
+  argc -= optind;
+
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
 
-  fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
+  fsfd = open(argv[0], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0){
-    perror(argv[1]);
+    perror(argv[0]);
+    exit(1);
+  }
+  img = mmap(0, FSSIZE*BSIZE, PROT_READ|PROT_WRITE,
+             MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(img == MAP_FAILED){
+    perror("mmap");
     exit(1);
   }
 
   // 1 fs block = 1 disk sector
-  nmeta = 2 + nlog + ninodeblocks + nbitmap;
+  ninodeblocks = ipg / IPB;
+  nmeta = 2 + nlog + ngroups * (1 + ninodeblocks);
   nblocks = FSSIZE - nmeta;
 
   sb.size = xint(FSSIZE);
   sb.nblocks = xint(nblocks);
-  sb.ninodes = xint(NINODES);
+  sb.ninodes = xint(ngroups * ipg);
   sb.nlog = xint(nlog);
   sb.logstart = xint(2);
-  sb.inodestart = xint(2+nlog);
-  sb.bmapstart = xint(2+nlog+ninodeblocks);
-
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  sb.groupstart = xint(2+nlog);
+  sb.ngroups = xint(ngroups);
+  sb.bpg = xint(BPG);
+  sb.ipg = xint(ipg);
+  sb.swapstart = xint(FSSIZE);
+  sb.nswap = xint(SWAPSIZE);
+  assert(FSSIZE - GSTART(ngroups-1, sb) > 1 + ninodeblocks);
 
-  freeblock = nmeta;     // the first free block that we can allocate
+  printf("nmeta %d (boot, super, log blocks %u, %d groups of bitmap block 1 inode blocks %u) blocks %d total %d\n",
+         nmeta, nlog, ngroups, ninodeblocks, nblocks, FSSIZE);
+  printf("swap blocks %d at %d\n", SWAPSIZE, FSSIZE);
 
-  for(i = 0; i < FSSIZE; i++)
-    wsect(i, zeroes);
+  // the first free block that we can allocate
+  freeblock = GSTART(0, sb) + 1 + ninodeblocks;
 
-  memset(buf, 0, sizeof(buf));
-  memmove(buf, &sb, sizeof(sb));
-  wsect(1, buf);
+  memmove(block(1), &sb, sizeof(sb));
 
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
+  dirlink(rootino, ".", rootino);
+  dirlink(rootino, "..", rootino);
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
-
-  for(i = 2; i < argc; i++){
+  for(i = 1; i < argc; i++){
     assert(index(argv[i], '/') == 0);
 
-    if((fd = open(argv[i], 0)) < 0){
-      perror(argv[i]);
-      exit(1);
-    }
-
     // Skip leading _ in name when writing to file system.
     // The binaries are named _rm, _cat, etc. to keep the
     // build operating system from trying to execute them
     // in place of system binaries like rm and cat.
-    if(argv[i][0] == '_')
-      ++argv[i];
-
-    inum = ialloc(T_FILE);
-
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, argv[i], DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
-
-    while((cc = read(fd, buf, sizeof(buf))) > 0)
-      iappend(inum, buf, cc);
-
-    close(fd);
+    mkfile(argv[i][0] == '_' ? argv[i] + 1 : argv[i], argv[i]);
   }
+  if(man)
+    manifest(man);
+
+  for(i = 0; i < nthread; i++)
+    pthread_create(&th[i], 0, importer, 0);
+  for(i = 0; i < nthread; i++)
+    pthread_join(th[i], 0);
 
   // fix size of root inode dir
-  rinode(rootino, &din);
-  off = xint(din.size);
+  din = dinode(rootino);
+  off = xint(din->size);
   off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  din->size = xint(off);
 
   balloc(freeblock);
+  wimage();
 
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  printf("mkfs: %d inodes, %d blocks, %d files read by %d threads in %ld ms\n",
+         freeinode - 1, freeblock, njob, nthread,
+         (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000);
   exit(0);
 }
 
-void
-wsect(uint sec, void *buf)
-{
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE){
-    perror("lseek");
-    exit(1);
-  }
-  if(write(fsfd, buf, BSIZE) != BSIZE){
-    perror("write");
-    exit(1);
-  }
-}
-
-void
-winode(uint inum, struct dinode *ip)
-{
-  char buf[BSIZE];
-  uint bn;
-  struct dinode *dip;
-
-  bn = IBLOCK(inum, sb);
-  rsect(bn, buf);
-  dip = ((struct dinode*)buf) + (inum % IPB);
-  *dip = *ip;
-  wsect(bn, buf);
-}
-
-void
-rinode(uint inum, struct dinode *ip)
-{
-  char buf[BSIZE];
-  uint bn;
-  struct dinode *dip;
-
-  bn = IBLOCK(inum, sb);
-  rsect(bn, buf);
-  dip = ((struct dinode*)buf) + (inum % IPB);
-  *ip = *dip;
-}
-
-void
-rsect(uint sec, void *buf)
+uint
+ialloc(ushort type)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE){
-    perror("lseek");
-    exit(1);
-  }
-  if(read(fsfd, buf, BSIZE) != BSIZE){
-    perror("read");
-    exit(1);
-  }
+  uint inum = freeinode++;
+  struct dinode *din;
+
+  assert(inum < ngroups * ipg);
+  din = dinode(inum);
+  bzero(din, sizeof(*din));
+  din->type = xshort(type);
+  din->nlink = xshort(1);
+  din->size = xint(0);
+  return inum;
 }
 
+// Return the next free data block, skipping the free map
+// and inodes at the start of each group.
 uint
-ialloc(ushort type)
+newblock(void)
 {
-  uint inum = freeinode++;
-  struct dinode din;
+  uint b;
 
-  bzero(&din, sizeof(din));
-  din.type = xshort(type);
-  din.nlink = xshort(1);
-  din.size = xint(0);
-  winode(inum, &din);
-  return inum;
+  b = freeblock++;
+  if(BINDEX(b, sb) == 0){
+    b += 1 + ninodeblocks;
+    freeblock = b + 1;
+  }
+  assert(b < FSSIZE);
+  return b;
 }
 
+// Write the free map of each group: its own free map and inode
+// blocks are in use, as is every data block below used.
 void
 balloc(int used)
 {
-  uchar buf[BSIZE];
-  int i;
+  uchar *buf;
+  uint g, b, bi, n;
 
   printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < BSIZE*8);
-  bzero(buf, BSIZE);
-  for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  for(g = 0; g < ngroups; g++){
+    buf = block(GSTART(g, sb));
+    n = g == ngroups-1 ? FSSIZE - GSTART(g, sb) : BPG;
+    for(bi = 0; bi < n; bi++){
+      b = GSTART(g, sb) + bi;
+      if(bi < 1 + ninodeblocks || b < used)
+        buf[bi/8] = buf[bi/8] | (0x1 << (bi%8));
+    }
   }
-  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
+  printf("balloc: wrote %d bitmap blocks\n", ngroups);
 }
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
@@ -259,41 +589,17 @@ iappend(uint inum, void *xp, int n)
 {
   char *p = (char*)xp;
   uint fbn, off, n1;
-  struct dinode din;
-  char buf[BSIZE];
-  uint indirect[NINDIRECT];
-  uint x;
-
-  rinode(inum, &din);
-  off = xint(din.size);
-  // printf("append inum %d at off %d sz %d\n", inum, off, n);
+  struct dinode *din;
+
+  din = dinode(inum);
+  off = xint(din->size);
   while(n > 0){
     fbn = off / BSIZE;
-    assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
     n1 = min(n, (fbn + 1) * BSIZE - off);
-    rsect(x, buf);
-    bcopy(p, buf + off - (fbn * BSIZE), n1);
-    wsect(x, buf);
+    bcopy(p, block(bmap(din, fbn)) + off - (fbn * BSIZE), n1);
     n -= n1;
     off += n1;
     p += n1;
   }
-  din.size = xint(off);
-  winode(inum, &din);
+  din->size = xint(off);
 }
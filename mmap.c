@@ -0,0 +1,308 @@
+// Memory-mapped files.
+//
+// mmap() maps part of a regular file into the address space of
+// the calling process, somewhere between MMAPBASE and KERNBASE.
+// Nothing is read at mmap() time: each page is faulted in on first
+// touch (see pagefault() in vm.c), straight from the page cache,
+// so a mapping shares its pages with readi() and with every other
+// process that maps the same file.
+//
+// A MAP_SHARED, PROT_WRITE mapping writes the cached page itself;
+// write() and read() see the change at once. The pages the process
+// dirtied (PTE_D) go back to the file, through the log, when the
+// region is unmapped or the process exits or execs.
+// A MAP_PRIVATE mapping maps the cached pages copy-on-write.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "stat.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+// Return the region of p that contains va, or 0.
+struct vma*
+mmapfind(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && v->start <= va && va < v->end)
+      return v;
+  return 0;
+}
+
+// Map len bytes of f, starting at file offset off, into the
+// current process. Returns the address of the mapping, or -1.
+// The mappings belong to the leader of the process's threads;
+// the caller holds mmlock().
+int
+mmap(struct file *f, uint len, int prot, int flags, uint off)
+{
+  struct proc *curproc = myproc()->group;
+  struct vma *v, *w;
+  uint start;
+
+  if(f->type != FD_INODE || f->ip->type != T_FILE)
+    return -1;
+  if(len == 0 || off % PGSIZE != 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if((prot & PROT_READ) && !f->readable)
+    return -1;
+  if((prot & PROT_WRITE) && flags == MAP_SHARED && !f->writable)
+    return -1;
+
+  for(v = curproc->vma; v < &curproc->vma[NVMA]; v++)
+    if(v->start == 0)
+      break;
+  if(v == &curproc->vma[NVMA])
+    return -1;
+
+  // First fit above MMAPBASE.
+  len = PGROUNDUP(len);
+  start = MMAPBASE;
+again:
+  for(w = curproc->vma; w < &curproc->vma[NVMA]; w++){
+    if(w->start && w->start < start + len && start < w->end){
+      start = w->end;
+      goto again;
+    }
+  }
+  if(start + len > KERNBASE || start + len < start)
+    return -1;
+
+  v->start = start;
+  v->end = start + len;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = filedup(f);
+  v->off = off;
+  return start;
+}
+
+// Fault in the page of a mapped file at va.
+// err is the page fault error code (0 for a read).
+// Returns 0 on success, -1 if va is not mapped or
+// the access is not allowed.
+int
+mmapfault(uint va, uint err)
+{
+  struct proc *curproc = myproc()->group;
+  struct vma *v;
+  struct inode *ip;
+  pte_t *pte;
+  char *mem;
+  int perm;
+
+  if((v = mmapfind(curproc, va)) == 0)
+    return -1;
+  if((err & FEC_WR) && !(v->prot & PROT_WRITE))
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walkpgdir(curproc->pgdir, (char*)va, 0)) != 0 && (*pte & PTE_P))
+    return 0;
+
+  ip = v->f->ip;
+  ilock_shared(ip);
+  mem = pcache_get(ip, v->off + (va - v->start));
+  iunlock_shared(ip);
+  if(mem == 0)
+    return -1;
+
+  if(!(v->prot & PROT_WRITE))
+    perm = PTE_U;
+  else if(v->flags == MAP_SHARED)
+    perm = PTE_W|PTE_U;
+  else
+    perm = PTE_COW|PTE_U;   // a write faults again and copies
+  if(mappages(curproc->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  kstatinc(KS_MMAPFAULT);
+  return 0;
+}
+
+// Check that [va, va+n) lies in one mapped region of the current
+// process. Returns 0 if so, -1 if not.
+int
+mmapcheck(uint va, uint n)
+{
+  struct vma *v;
+
+  if((v = mmapfind(myproc()->group, va)) == 0)
+    return -1;
+  if(va + n < va || va + n > v->end)
+    return -1;
+  return 0;
+}
+
+// Write the pages of v in [lo, hi) that p has modified
+// back to the file. Only MAP_SHARED mappings write back.
+static void
+writeback(struct proc *p, struct vma *v, uint lo, uint hi)
+{
+  // See filewrite() for the transaction size.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+  struct inode *ip = v->f->ip;
+  pte_t *pte;
+  uint a, off, i, n;
+  char *page;
+
+  if(v->flags != MAP_SHARED || !(v->prot & PROT_WRITE))
+    return;
+  for(a = lo; a < hi; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte == 0 || !(*pte & PTE_P) || !(*pte & PTE_D))
+      continue;
+    page = P2V(PTE_ADDR(*pte));
+    off = v->off + (a - v->start);
+    for(i = 0; i < PGSIZE; i += n){
+      n = PGSIZE - i;
+      if(n > max)
+        n = max;
+      begin_op();
+      ilock(ip);
+      // A mapping never extends the file.
+      if(off + i >= ip->size)
+        n = 0;
+      else if(off + i + n > ip->size)
+        n = ip->size - (off + i);
+      if(n > 0)
+        writei(ip, page + i, off + i, n);
+      iunlock(ip);
+      end_op();
+      if(n == 0)
+        break;
+    }
+    *pte &= ~PTE_D;
+  }
+}
+
+// Unmap [lo, hi) of region v of p, writing back
+// modified pages, and shrink or drop v to match.
+static void
+unmap(struct proc *p, struct vma *v, uint lo, uint hi)
+{
+  writeback(p, v, lo, hi);
+  deallocuvm(p->pgdir, hi, lo);
+  if(lo == v->start && hi == v->end){
+    fileclose(v->f);
+    memset(v, 0, sizeof(*v));
+  } else if(lo == v->start){
+    v->off += hi - v->start;
+    v->start = hi;
+  } else {
+    v->end = lo;
+  }
+}
+
+// Remove the mappings in [addr, addr+len) from the current process.
+// Returns 0 on success, -1 on error. The caller holds mmlock().
+int
+munmap(uint addr, uint len)
+{
+  struct proc *curproc = myproc()->group;
+  struct vma *v, *w;
+  uint end, lo, hi;
+
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+  end = PGROUNDUP(addr + len);
+  if(end <= addr || addr < MMAPBASE || end > KERNBASE)
+    return -1;
+
+  for(v = curproc->vma; v < &curproc->vma[NVMA]; v++){
+    if(v->start == 0 || v->end <= addr || end <= v->start)
+      continue;
+    lo = addr > v->start ? addr : v->start;
+    hi = end < v->end ? end : v->end;
+    if(lo > v->start && hi < v->end){
+      // Punching a hole: the part above it becomes a new region.
+      for(w = curproc->vma; w < &curproc->vma[NVMA]; w++)
+        if(w->start == 0)
+          break;
+      if(w == &curproc->vma[NVMA])
+        return -1;
+      *w = *v;
+      w->off += hi - v->start;
+      w->start = hi;
+      filedup(w->f);
+      v->end = hi;
+    }
+    unmap(curproc, v, lo, hi);
+  }
+  flushtlb();
+  return 0;
+}
+
+// Remove all the mappings of p.
+void
+munmapall(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start)
+      unmap(p, v, v->start, v->end);
+}
+
+// Give np, a child of p being created by fork(), the mappings of p.
+// Shared mappings and copy-on-write pages are shared with the child;
+// private pages the parent has already written are copied.
+// Returns 0 on success, -1 if out of memory.
+int
+mmapfork(struct proc *np, struct proc *p)
+{
+  struct vma *v, *nv;
+  pte_t *pte;
+  uint a, pa, flags;
+  char *mem;
+
+  for(v = p->vma, nv = np->vma; v < &p->vma[NVMA]; v++, nv++){
+    if(v->start == 0)
+      continue;
+    *nv = *v;
+    filedup(nv->f);
+    for(a = v->start; a < v->end; a += PGSIZE){
+      pte = walkpgdir(p->pgdir, (char*)a, 0);
+      if(pte == 0 || !(*pte & PTE_P))
+        continue;
+      pa = PTE_ADDR(*pte);
+      flags = PTE_FLAGS(*pte);
+      if(v->flags == MAP_SHARED || !(flags & PTE_W)){
+        if(mappages(np->pgdir, (char*)a, PGSIZE, pa, flags) < 0)
+          goto bad;
+        kref(P2V(pa));
+      } else {
+        if((mem = kalloc()) == 0)
+          goto bad;
+        memmove(mem, P2V(pa), PGSIZE);
+        if(mappages(np->pgdir, (char*)a, PGSIZE, V2P(mem), flags) < 0){
+          kfree(mem);
+          goto bad;
+        }
+      }
+    }
+  }
+  return 0;
+
+bad:
+  // The caller frees np's page table and the pages in it.
+  for(nv = np->vma; nv < &np->vma[NVMA]; nv++){
+    if(nv->start){
+      fileclose(nv->f);
+      memset(nv, 0, sizeof(*nv));
+    }
+  }
+  return -1;
+}
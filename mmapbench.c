@@ -0,0 +1,145 @@
+// mmap benchmark: scan an 8MB file the way wc and grep do,
+// once through read() into a small buffer and once through
+// mmap(), then time the wc and grep programs themselves.
+// Uses the file left behind by sanity, or makes one like it.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+#define FILESIZE (8*1024*1024)
+
+char buf[512];
+int nl, nw, nc, inword;
+
+void
+count(char *p, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    nc++;
+    if(p[i] == '\n')
+      nl++;
+    if(strchr(" \r\t\n\v", p[i]))
+      inword = 0;
+    else if(!inword){
+      nw++;
+      inword = 1;
+    }
+  }
+}
+
+// Write FILESIZE bytes of the text sanity writes.
+void
+makefile(char *name)
+{
+  char *text = "0123456789abcdef";
+  int fd, i;
+
+  printf(1, "mmapbench: creating %s\n", name);
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = text[i % 16];
+  if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+    printf(1, "mmapbench: cannot create %s\n", name);
+    exit();
+  }
+  for(i = 0; i < FILESIZE; i += sizeof(buf)){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(1, "mmapbench: write %s failed\n", name);
+      exit();
+    }
+  }
+  close(fd);
+}
+
+int
+scanread(char *name)
+{
+  int fd, n, t0;
+
+  t0 = uptime();
+  nl = nw = nc = inword = 0;
+  if((fd = open(name, O_RDONLY)) < 0)
+    return -1;
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    count(buf, n);
+  close(fd);
+  return uptime() - t0;
+}
+
+int
+scanmmap(char *name)
+{
+  struct stat st;
+  int fd, t0;
+  char *p;
+
+  t0 = uptime();
+  nl = nw = nc = inword = 0;
+  if((fd = open(name, O_RDONLY)) < 0)
+    return -1;
+  fstat(fd, &st);
+  p = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED){
+    close(fd);
+    return -1;
+  }
+  count(p, st.size);
+  munmap(p, st.size);
+  close(fd);
+  return uptime() - t0;
+}
+
+// Run a program and return how long it took.
+int
+run(char **argv)
+{
+  int pid, t0;
+
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0)
+    return -1;
+  if(pid == 0){
+    exec(argv[0], argv);
+    printf(1, "mmapbench: exec %s failed\n", argv[0]);
+    exit();
+  }
+  wait();
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *name = argc > 1 ? argv[1] : "testfile";
+  char *wcargv[] = { "wc", name, 0 };
+  char *grepargv[] = { "grep", "fedc", name, 0 };
+  struct stat st;
+  int i, t, f0;
+
+  if(stat(name, &st) < 0 || st.size < FILESIZE)
+    makefile(name);
+
+  for(i = 0; i < 2; i++){
+    t = scanread(name);
+    printf(1, "mmapbench: read() pass %d: %d ticks (%d %d %d)\n",
+           i, t, nl, nw, nc);
+  }
+  for(i = 0; i < 2; i++){
+    f0 = kstat(KS_MMAPFAULT);
+    t = scanmmap(name);
+    printf(1, "mmapbench: mmap() pass %d: %d ticks (%d %d %d), %d faults\n",
+           i, t, nl, nw, nc, kstat(KS_MMAPFAULT) - f0);
+  }
+  printf(1, "mmapbench: page cache holds %d pages\n", kstat(KS_PCPAGES));
+
+  t = run(wcargv);
+  printf(1, "mmapbench: wc %s: %d ticks\n", name, t);
+  t = run(grepargv);
+  printf(1, "mmapbench: grep fedc %s: %d ticks\n", name, t);
+  exit();
+}
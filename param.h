@@ -1,16 +1,24 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC       512  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
-#define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE      200  // maximum number of active i-nodes
+#define TICKNS   10000000  // nanoseconds per scheduling tick
+#define NOFILE       16  // open files per process, before its table grows
+#define NOFILEMAX  1024  // open files per process, in a grown table
+#define NFILE      8192  // open files per system
+#define NINODE     4096  // maximum number of cached i-nodes
+#define NIHASH     1021  // inode cache hash buckets
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define LOGSIZE      (MAXOPBLOCKS*8)  // blocks in on-disk log, in two halves
+#define NBUF         (MAXOPBLOCKS*12) // size of disk block cache
+#define NPCACHE    4096  // pages held by the page cache
+#define NPCHASH    1021  // page cache hash buckets
+#define NVMA         16  // mmap()ed regions per process
+#define PIPEPAGES     4  // pages in a pipe's buffer (a power of 2)
 #define FSSIZE       32768  // size of file system in blocks -changed by Noy
+#define SWAPSIZE     65536  // size of swap area in blocks, after the file system
 #define MAX_DEREFERENCE 31
 #define DEBUG 0
 #define FILENAMESIZE 512
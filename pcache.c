@@ -0,0 +1,274 @@
+// Page cache.
+//
+// The page cache holds whole pages of file content so that
+// several processes can map the same physical page instead of
+// each reading a private copy with readi(). exec() uses it to
+// share the text of programs between all processes running them.
+//
+// A cached page is named by (dev, inum, off), where off is the
+// file offset of the first byte in the page. off need not be
+// page-aligned (an ELF segment starts wherever the linker put it),
+// so entries are hashed on off/PGSIZE and pcache_inval() also
+// looks in the slot below the range it drops.
+//
+// readi() copies from a page-aligned cached page when there is one,
+// and writei() updates such pages in place, so they always hold the
+// current file contents and mmap() (see mmap.c) can map them.
+// Unaligned entries are dropped when the file is written; processes
+// that already map them keep the old contents.
+//
+// The cache holds one reference (see kref() in kalloc.c) to each
+// of its pages; an entry whose page has no other references can be
+// recycled.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "kstat.h"
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;             // file offset of the first byte
+  char *page;
+  struct pcpage *next;  // hash chain, or free list
+};
+
+struct {
+  struct spinlock lock;
+  struct pcpage ent[NPCACHE];
+  struct pcpage *hash[NPCHASH];
+  struct pcpage *free;
+  uint hand;            // clock hand for recycling entries
+} pcache;
+
+static uint
+pchash(uint dev, uint inum, uint pgno)
+{
+  return (dev*7 + inum*31 + pgno) % NPCHASH;
+}
+
+void
+pcacheinit(void)
+{
+  struct pcpage *e;
+
+  initlock(&pcache.lock, "pcache");
+  for(e = pcache.ent; e < pcache.ent+NPCACHE; e++){
+    e->next = pcache.free;
+    pcache.free = e;
+  }
+}
+
+// Find the entry for (dev, inum, off).
+// Caller must hold pcache.lock.
+static struct pcpage*
+pclookup(uint dev, uint inum, uint off)
+{
+  struct pcpage *e;
+
+  for(e = pcache.hash[pchash(dev, inum, off/PGSIZE)]; e; e = e->next)
+    if(e->dev == dev && e->inum == inum && e->off == off)
+      return e;
+  return 0;
+}
+
+// Unhash e, drop the cache's reference to its page
+// and put e on the free list.
+// Caller must hold pcache.lock.
+static void
+pcremove(struct pcpage *e)
+{
+  struct pcpage **pp;
+
+  pp = &pcache.hash[pchash(e->dev, e->inum, e->off/PGSIZE)];
+  while(*pp != e)
+    pp = &(*pp)->next;
+  *pp = e->next;
+  kfree(e->page);
+  e->page = 0;
+  e->next = pcache.free;
+  pcache.free = e;
+  kstats[KS_PCPAGES]--;
+}
+
+// Allocate an entry, recycling one whose page
+// nobody else maps if the cache is full.
+// Caller must hold pcache.lock.
+static struct pcpage*
+pcalloc(void)
+{
+  struct pcpage *e;
+  int i;
+
+  for(i = 0; pcache.free == 0 && i < NPCACHE; i++){
+    e = &pcache.ent[pcache.hand];
+    pcache.hand = (pcache.hand + 1) % NPCACHE;
+    if(e->page && krefcount(e->page) == 1)
+      pcremove(e);
+  }
+  if((e = pcache.free) != 0)
+    pcache.free = e->next;
+  return e;
+}
+
+// Drop one cached page that nobody maps, to give its memory
+// back to kalloc(). Returns 0 if it found one, -1 if not.
+int
+pcache_reclaim(void)
+{
+  struct pcpage *e;
+  int i;
+
+  if(kstats[KS_PCPAGES] == 0)
+    return -1;
+  acquire(&pcache.lock);
+  for(i = 0; i < NPCACHE; i++){
+    e = &pcache.ent[pcache.hand];
+    pcache.hand = (pcache.hand + 1) % NPCACHE;
+    if(e->page && krefcount(e->page) == 1){
+      pcremove(e);
+      release(&pcache.lock);
+      return 0;
+    }
+  }
+  release(&pcache.lock);
+  return -1;
+}
+
+// Return a page holding the PGSIZE bytes of ip starting at off;
+// bytes past the end of the file read as zero. The caller gets
+// its own reference to the page. Only a MAP_SHARED mapping may
+// write to it while it may still be cached. Returns 0 if out of
+// memory.
+// Caller must hold ip->lock.
+char*
+pcache_get(struct inode *ip, uint off)
+{
+  struct pcpage *e;
+  char *mem;
+  int n;
+
+  acquire(&pcache.lock);
+  if((e = pclookup(ip->dev, ip->inum, off)) != 0){
+    kref(e->page);
+    release(&pcache.lock);
+    kstatinc(KS_PCHIT);
+    return e->page;
+  }
+  release(&pcache.lock);
+  kstatinc(KS_PCMISS);
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  if((n = readi(ip, mem, off, PGSIZE)) < 0)
+    n = 0;
+  memset(mem + n, 0, PGSIZE - n);
+
+  acquire(&pcache.lock);
+  if((e = pclookup(ip->dev, ip->inum, off)) != 0){
+    // Somebody else read the same page meanwhile.
+    kref(e->page);
+    release(&pcache.lock);
+    kfree(mem);
+    return e->page;
+  }
+  if((e = pcalloc()) != 0){
+    e->dev = ip->dev;
+    e->inum = ip->inum;
+    e->off = off;
+    e->page = mem;
+    kref(mem);
+    e->next = pcache.hash[pchash(ip->dev, ip->inum, off/PGSIZE)];
+    pcache.hash[pchash(ip->dev, ip->inum, off/PGSIZE)] = e;
+    kstats[KS_PCPAGES]++;
+  }
+  release(&pcache.lock);
+  return mem;
+}
+
+// Bring the cached pages of ip up to date after a write of n bytes
+// at off: page-aligned pages that overlap the range get a copy of
+// the new bytes from src; the others (and all of them if src is 0)
+// are dropped.
+// Caller must hold ip->lock.
+static void
+pcupdate(struct inode *ip, char *src, uint off, uint n)
+{
+  struct pcpage *e, *next;
+  uint pgno, last, lo, hi;
+
+  if(kstats[KS_PCPAGES] == 0 || n == 0)
+    return;
+
+  // A page overlaps the range if it starts in (off-PGSIZE, off+n).
+  pgno = off/PGSIZE;
+  if(pgno > 0)
+    pgno--;
+  last = (off + n - 1)/PGSIZE;
+
+  acquire(&pcache.lock);
+  for(; pgno <= last; pgno++){
+    for(e = pcache.hash[pchash(ip->dev, ip->inum, pgno)]; e; e = next){
+      next = e->next;
+      if(e->dev != ip->dev || e->inum != ip->inum ||
+         e->off >= off + n || e->off + PGSIZE <= off)
+        continue;
+      if(src == 0 || e->off % PGSIZE != 0){
+        pcremove(e);
+        continue;
+      }
+      lo = off > e->off ? off : e->off;
+      hi = off + n < e->off + PGSIZE ? off + n : e->off + PGSIZE;
+      memmove(e->page + (lo - e->off), src + (lo - off), hi - lo);
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Drop the cached pages that overlap bytes [off, off+n) of ip.
+// Caller must hold ip->lock.
+void
+pcache_inval(struct inode *ip, uint off, uint n)
+{
+  pcupdate(ip, 0, off, n);
+}
+
+// writei() has just written the n bytes at src to ip at off.
+// Caller must hold ip->lock.
+void
+pcache_write(struct inode *ip, char *src, uint off, uint n)
+{
+  pcupdate(ip, src, off, n);
+}
+
+// Copy the n bytes of ip at off, which must not cross a page
+// boundary, into dst if the page holding them is cached.
+// Returns 0 if it was, -1 if the caller must read the file.
+// Caller must hold ip->lock.
+int
+pcache_read(struct inode *ip, char *dst, uint off, uint n)
+{
+  struct pcpage *e;
+  char *page;
+
+  if(kstats[KS_PCPAGES] == 0)
+    return -1;
+  acquire(&pcache.lock);
+  if((e = pclookup(ip->dev, ip->inum, PGROUNDDOWN(off))) == 0){
+    release(&pcache.lock);
+    return -1;
+  }
+  page = e->page;
+  kref(page);
+  release(&pcache.lock);
+  // dst may be user memory; copy without holding the lock.
+  memmove(dst, page + off%PGSIZE, n);
+  kfree(page);
+  return 0;
+}
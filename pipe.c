@@ -8,21 +8,39 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+// A pipe's buffer is a ring of PIPEPAGES pages, which need not be
+// contiguous. Reads and writes copy a page-contiguous run at a time,
+// and wake the other side only when it is asleep waiting for them.
+
+#define PIPESIZE (PIPEPAGES*PGSIZE)
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *data[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int readwait;   // readers asleep for data
+  int writewait;  // writers asleep for room
 };
 
+static void
+pipefree(struct pipe *p)
+{
+  int i;
+
+  for(i = 0; i < PIPEPAGES; i++)
+    if(p->data[i])
+      kfree(p->data[i]);
+  kfree((char*)p);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *p;
+  int i;
 
   p = 0;
   *f0 = *f1 = 0;
@@ -30,6 +48,10 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(p, 0, sizeof(*p));
+  for(i = 0; i < PIPEPAGES; i++)
+    if((p->data[i] = kalloc()) == 0)
+      goto bad;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
@@ -48,7 +70,7 @@ pipealloc(struct file **f0, struct file **f1)
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    pipefree(p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -69,30 +91,62 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    pipefree(p);
   } else
     release(&p->lock);
 }
 
+// Copy n bytes from addr into the ring at offset off (in set)
+// or out of it to addr, in runs that do not cross a page.
+static void
+pipecopy(struct pipe *p, uint off, char *addr, int n, int in)
+{
+  char *d;
+  int m;
+
+  while(n > 0){
+    off %= PIPESIZE;
+    d = p->data[off / PGSIZE] + off % PGSIZE;
+    m = PGSIZE - off % PGSIZE;
+    if(m > n)
+      m = n;
+    if(in)
+      memmove(d, addr, m);
+    else
+      memmove(addr, d, m);
+    off += m;
+    addr += m;
+    n -= m;
+  }
+}
+
 //PAGEBREAK: 40
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
-  int i;
+  int i, m;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
+  for(i = 0; i < n; i += m){
     while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
+      if(p->readwait)
+        wakeup(&p->nread);
+      p->writewait++;
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      p->writewait--;
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    m = PIPESIZE - (p->nwrite - p->nread);
+    if(m > n - i)
+      m = n - i;
+    pipecopy(p, p->nwrite, addr + i, m, 1);
+    p->nwrite += m;
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  if(p->readwait)
+    wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   release(&p->lock);
   return n;
 }
@@ -100,7 +154,7 @@ pipewrite(struct pipe *p, char *addr, int n)
 int
 piperead(struct pipe *p, char *addr, int n)
 {
-  int i;
+  int m;
 
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
@@ -108,14 +162,19 @@ piperead(struct pipe *p, char *addr, int n)
       release(&p->lock);
       return -1;
     }
+    p->readwait++;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+    p->readwait--;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  m = p->nwrite - p->nread;  //DOC: piperead-copy
+  if(m > n)
+    m = n;
+  if(m > 0){
+    pipecopy(p, p->nread, addr, m, 0);
+    p->nread += m;
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  if(p->writewait)
+    wakeup(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
-  return i;
+  return m;
 }
@@ -0,0 +1,65 @@
+// Pipe throughput benchmark. A child writes NBYTES into a pipe in
+// writes of each size below while the parent reads it with reads of
+// the same size, so that, with two or more CPUs, writer and reader
+// run at once. Reports the rate for each size.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+#define NBYTES (8*1024*1024)
+
+int sizes[] = { 512, 4096, 16384, 65536 };
+char buf[65536];
+
+int
+run(int size)
+{
+  int fd[2], i, n, got;
+  uint64 t0, t1;
+  uint ms;
+
+  if(pipe(fd) < 0){
+    printf(1, "pipebench: pipe failed\n");
+    exit();
+  }
+  nsuptime(&t0);
+  if(fork() == 0){
+    close(fd[0]);
+    for(i = 0; i < NBYTES; i += size)
+      if(write(fd[1], buf, size) != size){
+        printf(1, "pipebench: write failed\n");
+        break;
+      }
+    exit();
+  }
+  close(fd[1]);
+  got = 0;
+  while((n = read(fd[0], buf, size)) > 0)
+    got += n;
+  close(fd[0]);
+  wait();
+  nsuptime(&t1);
+  if(got != NBYTES)
+    printf(1, "pipebench: read %d bytes, not %d\n", got, NBYTES);
+  ms = (uint)(t1 - t0) / 1000000;
+  if(ms == 0)
+    ms = 1;
+  return got / 1024 * 1000 / ms;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, kbs;
+
+  printf(1, "pipebench: %d CPUs, %d MB through a pipe\n",
+         kstat(KS_NCPU), NBYTES / (1024*1024));
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+    kbs = run(sizes[i]);
+    printf(1, "pipebench: %d-byte writes: %d KB/s (%d.%d MB/s)\n",
+           sizes[i], kbs, kbs / 1024, kbs * 10 / 1024 % 10);
+  }
+  exit();
+}
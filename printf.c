@@ -2,14 +2,172 @@
 #include "stat.h"
 #include "user.h"
 
+// Buffered output streams. A stream collects output in its
+// buffer and writes it out with one system call when the buffer
+// is full (_IOFBF), at each newline too (_IOLBF), or after every
+// call (_IONBF). sout, on fd 1, is line buffered on the console
+// and fully buffered into a file or pipe; serr, on fd 2, is
+// unbuffered. exit() flushes every stream (see ulib.c).
+
+#define STREAMBUF 512
+
+struct stream {
+  int fd;
+  int mode;               // _IOFBF, _IOLBF, _IONBF, or -1 if not yet set
+  int n;                  // bytes in buf
+  int size;               // size of buf
+  char *buf;
+  struct stream *next;    // list of streams to flush at exit
+};
+
+static char outbuf[STREAMBUF];
+static struct stream outstream = { 1, -1, 0, STREAMBUF, outbuf, 0 };
+static struct stream errstream = { 2, _IONBF, 0, 0, 0, 0 };
+struct stream *sout = &outstream;
+struct stream *serr = &errstream;
+
+static struct stream *streams;
+
 static void
-putc(int fd, char c)
+flushall(void)
 {
-  write(fd, &c, 1);
+  struct stream *s;
+
+  for(s = streams; s; s = s->next)
+    fflush(s);
 }
 
 static void
-printint(int fd, int xx, int base, int sgn)
+addstream(struct stream *s)
+{
+  s->next = streams;
+  streams = s;
+  exitflush = flushall;
+}
+
+// Choose sout's buffering by what fd 1 turned out to be.
+static void
+setmode(struct stream *s)
+{
+  struct stat st;
+
+  if(fstat(s->fd, &st) == 0 && st.type == T_DEV)
+    s->mode = _IOLBF;
+  else
+    s->mode = _IOFBF;
+  addstream(s);
+}
+
+int
+fflush(struct stream *s)
+{
+  int r;
+
+  r = 0;
+  if(s->n > 0 && write(s->fd, s->buf, s->n) != s->n)
+    r = -1;
+  s->n = 0;
+  return r;
+}
+
+// Make a stream that writes to fd, with the given buffering.
+// Returns 0 if out of memory.
+struct stream*
+fdopen(int fd, int mode)
+{
+  struct stream *s;
+
+  if((s = malloc(sizeof(*s) + STREAMBUF)) == 0)
+    return 0;
+  s->fd = fd;
+  s->mode = mode;
+  s->n = 0;
+  s->size = STREAMBUF;
+  s->buf = (char*)(s + 1);
+  addstream(s);
+  return s;
+}
+
+// Flush s and free it; the file descriptor stays open.
+int
+fclose(struct stream *s)
+{
+  struct stream **pp;
+  int r;
+
+  r = fflush(s);
+  for(pp = &streams; *pp; pp = &(*pp)->next)
+    if(*pp == s){
+      *pp = s->next;
+      break;
+    }
+  if(s != sout && s != serr)
+    free(s);
+  return r;
+}
+
+// Change the buffering of s. A stream with no buffer stays
+// unbuffered.
+void
+setvbuf(struct stream *s, int mode)
+{
+  if(s->mode == -1)
+    setmode(s);
+  fflush(s);
+  s->mode = s->size > 0 ? mode : _IONBF;
+}
+
+int
+fwrite(struct stream *s, void *p, int n)
+{
+  char *c = p;
+  int i, m;
+
+  if(s->mode == -1)
+    setmode(s);
+  if(s->mode == _IONBF || n >= s->size){
+    // Nothing to gain by copying it.
+    fflush(s);
+    return write(s->fd, p, n);
+  }
+  for(i = 0; i < n; i += m){
+    if(s->n == s->size)
+      fflush(s);
+    m = s->size - s->n;
+    if(m > n - i)
+      m = n - i;
+    memmove(s->buf + s->n, c + i, m);
+    s->n += m;
+  }
+  if(s->mode == _IOLBF)
+    for(i = 0; i < n; i++)
+      if(c[i] == '\n'){
+        fflush(s);
+        break;
+      }
+  return n;
+}
+
+int
+fputc(int c, struct stream *s)
+{
+  if(s->mode != _IOFBF || s->n == s->size){
+    char ch = c;
+    return fwrite(s, &ch, 1) == 1 ? c : -1;
+  }
+  // The common case: a fully buffered stream with room.
+  s->buf[s->n++] = c;
+  return c;
+}
+
+int
+fputs(char *str, struct stream *s)
+{
+  return fwrite(s, str, strlen(str));
+}
+
+static void
+printint(struct stream *s, int xx, int base, int sgn)
 {
   static char digits[] = "0123456789ABCDEF";
   char buf[16];
@@ -32,54 +190,71 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while(--i >= 0)
-    putc(fd, buf[i]);
+    fputc(buf[i], s);
 }
 
-// Print to the given fd. Only understands %d, %x, %p, %s.
-void
-printf(int fd, char *fmt, ...)
+// Format to s. Only understands %d, %x, %p, %s, %c.
+static void
+vprintf(struct stream *s, char *fmt, uint *ap)
 {
-  char *s;
+  char *str;
   int c, i, state;
-  uint *ap;
 
   state = 0;
-  ap = (uint*)(void*)&fmt + 1;
   for(i = 0; fmt[i]; i++){
     c = fmt[i] & 0xff;
     if(state == 0){
       if(c == '%'){
         state = '%';
       } else {
-        putc(fd, c);
+        fputc(c, s);
       }
     } else if(state == '%'){
       if(c == 'd'){
-        printint(fd, *ap, 10, 1);
+        printint(s, *ap, 10, 1);
         ap++;
       } else if(c == 'x' || c == 'p'){
-        printint(fd, *ap, 16, 0);
+        printint(s, *ap, 16, 0);
         ap++;
       } else if(c == 's'){
-        s = (char*)*ap;
+        str = (char*)*ap;
         ap++;
-        if(s == 0)
-          s = "(null)";
-        while(*s != 0){
-          putc(fd, *s);
-          s++;
-        }
+        if(str == 0)
+          str = "(null)";
+        fputs(str, s);
       } else if(c == 'c'){
-        putc(fd, *ap);
+        fputc(*ap, s);
         ap++;
       } else if(c == '%'){
-        putc(fd, c);
+        fputc(c, s);
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c);
+        fputc('%', s);
+        fputc(c, s);
       }
       state = 0;
     }
   }
 }
+
+void
+fprintf(struct stream *s, char *fmt, ...)
+{
+  vprintf(s, fmt, (uint*)(void*)&fmt + 1);
+}
+
+// Print to the given fd, with one write() for the whole call.
+void
+printf(int fd, char *fmt, ...)
+{
+  char buf[128];
+  struct stream s;
+
+  s.fd = fd;
+  s.mode = _IOFBF;
+  s.n = 0;
+  s.size = sizeof(buf);
+  s.buf = buf;
+  vprintf(&s, fmt, (uint*)(void*)&fmt + 1);
+  fflush(&s);
+}
@@ -4,12 +4,30 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
+#include "traps.h"
 #include "proc.h"
 #include "spinlock.h"
-
+#include "sched.h"
+#include "kstat.h"
+
+#define WAITQBITS 6
+#define NWAITQ (1 << WAITQBITS)   // wait queue buckets
+#define NPIDHASH  64              // pid hash buckets
+#define PROCPERPG (PGSIZE / sizeof(struct proc))
+
+// The process table. Procs are allocated a page at a time when
+// needed, up to NPROC of them, and are never freed. UNUSED procs
+// are on the free list and the others are hashed by pid. Each
+// process keeps a list of its children and, apart, one of those
+// that have exited, so that fork, exit, wait and kill never have
+// to look through the whole table.
 struct {
   struct spinlock lock;
-  struct proc proc[NPROC];
+  struct proc *all;             // Every proc, through allnext
+  int nproc;                    // Procs on the all list
+  struct proc *free;            // UNUSED procs, through next
+  struct proc *pidhash[NPIDHASH]; // The others by pid, through next
+  struct proc *waitq[NWAITQ];   // SLEEPING processes, hashed by chan
 } ptable;
 
 static struct proc *initproc;
@@ -19,11 +37,127 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void killproc(struct proc *p);
+static int fdfork(struct proc *np, struct proc *g);
+static void fdcloseall(struct proc *p);
+
+// Return the wait queue for chan. Channels are addresses,
+// so the low bits carry little; hash them with a multiply.
+static struct proc**
+waitq(void *chan)
+{
+  return &ptable.waitq[((uint)chan * 2654435761u) >> (32 - WAITQBITS)];
+}
+
+// Return the pid hash chain for pid. Pids are handed out
+// in sequence, so the low bits spread them evenly.
+static struct proc**
+pidhash(int pid)
+{
+  return &ptable.pidhash[(uint)pid % NPIDHASH];
+}
+
+// Return the process with the given pid, or 0.
+// The ptable lock must be held.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = *pidhash(pid); p; p = p->next)
+    if(p->pid == pid)
+      return p;
+  return 0;
+}
+
+// Put p at the head of a children or zombies list.
+static void
+childpush(struct proc **head, struct proc *p)
+{
+  p->sibling = *head;
+  if(*head)
+    (*head)->psibling = &p->sibling;
+  p->psibling = head;
+  *head = p;
+}
+
+// Take p out of the children or zombies list it is in.
+static void
+childremove(struct proc *p)
+{
+  *p->psibling = p->sibling;
+  if(p->sibling)
+    p->sibling->psibling = p->psibling;
+  p->sibling = 0;
+  p->psibling = 0;
+}
+
+// Add a page of UNUSED procs to the free list.
+// Returns 0, or -1 if there are NPROC procs already
+// or no memory. The ptable lock must be held.
+static int
+growptable(void)
+{
+  struct proc *p;
+  char *mem;
+  int i;
+
+  if(ptable.nproc >= NPROC || (mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  p = (struct proc*)mem;
+  for(i = 0; i < PROCPERPG && ptable.nproc < NPROC; i++, p++){
+    p->allnext = ptable.all;
+    ptable.all = p;
+    p->next = ptable.free;
+    ptable.free = p;
+    ptable.nproc++;
+  }
+  return 0;
+}
+
+// Take p, which is not on any list any more, out of the pid
+// hash and put it back on the free list.
+// The ptable lock must be held.
+static void
+freeproc(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = pidhash(p->pid); *pp != p; pp = &(*pp)->next)
+    ;
+  *pp = p->next;
+  if(p->ofile != p->ofile0){
+    kfree((char*)p->ofile);
+    p->ofile = p->ofile0;
+    p->nofile = NOFILE;
+  }
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  p->state = UNUSED;
+  p->next = ptable.free;
+  ptable.free = p;
+}
 
 void
 pinit(void)
 {
   initlock(&ptable.lock, "ptable");
+  kstats[KS_NCPU] = ncpu;
+}
+
+// Make p RUNNABLE and put it in the run queue of its home CPU
+// (see sched.c). The ptable lock must be held.
+static void
+setrunnable(struct proc *p)
+{
+  if(p->home == 0)
+    p->home = mycpu();
+  p->state = RUNNABLE;
+  runqput(p);
+  runqkick(p->home);
 }
 
 // Must be called with interrupts disabled
@@ -66,10 +200,10 @@ myproc(void) {
 }
 
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
-// Otherwise return 0.
+// Take an UNUSED proc from the free list, growing the
+// table if it is empty. If there is one, change state
+// to EMBRYO and initialize state required to run in
+// the kernel. Otherwise return 0.
 static struct proc*
 allocproc(void)
 {
@@ -78,22 +212,41 @@ allocproc(void)
 
   acquire(&ptable.lock);
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
-
-  release(&ptable.lock);
-  return 0;
+  if(ptable.free == 0 && growptable() < 0){
+    release(&ptable.lock);
+    return 0;
+  }
+  p = ptable.free;
+  ptable.free = p->next;
 
-found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->next = *pidhash(p->pid);
+  *pidhash(p->pid) = p;
+  p->children = 0;
+  p->zombies = 0;
+  p->group = p;
+  p->threads = 0;
+  p->nthread = 1;
+  p->mmbusy = 0;
+  if(p->ofile == 0){
+    // Fresh from growptable().
+    p->ofile = p->ofile0;
+    p->nofile = NOFILE;
+  }
+  p->home = 0;
+  p->nice = 0;
+  p->tickused = 0;
+  p->level = 0;
+  p->pass = 0;
 
   release(&ptable.lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(p);
+    release(&ptable.lock);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -148,21 +301,75 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&ptable.lock);
 }
 
+// Start a kernel process running fn(), which must never return.
+// It has only the kernel's mappings, and no parent: fn() is where
+// forkret() returns to, in place of trapret.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0 || (p->pgdir = setupkvm()) == 0)
+    panic("kthread");
+  *(uint*)(p->context + 1) = (uint)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  setrunnable(p);
+  release(&ptable.lock);
+}
+
+// Lock the memory layout (sz and vma) of the current process
+// against its other threads. May sleep.
+// A process with a single thread needs no lock: only that thread
+// could create another.
+void
+mmlock(void)
+{
+  struct proc *g = myproc()->group;
+
+  if(g->nthread == 1)
+    return;
+  acquire(&ptable.lock);
+  while(g->mmbusy)
+    sleep(&g->mmbusy, &ptable.lock);
+  g->mmbusy = 1;
+  release(&ptable.lock);
+}
+
+void
+mmunlock(void)
+{
+  struct proc *g = myproc()->group;
+
+  // Only the holder can have set it.
+  if(!g->mmbusy)
+    return;
+  acquire(&ptable.lock);
+  g->mmbusy = 0;
+  wakeup1(&g->mmbusy);
+  release(&ptable.lock);
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
+// Caller must hold mmlock().
 int
 growproc(int n)
 {
   uint sz;
-  struct proc *curproc = myproc();
+  struct proc *curproc = myproc()->group;
 
   sz = curproc->sz;
-  if(n > 0){
+  if(n > 0 && curproc->hugeheap){
+    if((sz = allochugeuvm(curproc->pgdir, sz, sz + n)) == 0)
+      return -1;
+  } else if(n > 0){
     if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   } else if(n < 0){
@@ -170,43 +377,71 @@ growproc(int n)
       return -1;
   }
   curproc->sz = sz;
-  switchuvm(curproc);
+  flushtlb();
   return 0;
 }
 
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
+// The child gets a copy of the whole process, but only of the
+// calling thread.
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
   struct proc *curproc = myproc();
+  struct proc *g = curproc->group;
 
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
   }
+  if(fdfork(np, g) < 0){
+    kfree(np->kstack);
+    np->kstack = 0;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  mmlock();
+  if((np->pgdir = copyuvm(curproc->pgdir, g->sz)) == 0){
+    mmunlock();
+    fdcloseall(np);
     kfree(np->kstack);
     np->kstack = 0;
-    np->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
     return -1;
   }
-  np->sz = curproc->sz;
-  np->parent = curproc;
+  if(mmapfork(np, g) < 0){
+    mmunlock();
+    fdcloseall(np);
+    freevm(np->pgdir);
+    kfree(np->kstack);
+    np->kstack = 0;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
+  np->sz = g->sz;
+  mmunlock();
+  np->hugeheap = g->hugeheap;
+  np->nice = curproc->nice;
+  np->pass = curproc->pass;
+  np->parent = g;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
-  for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
+  np->cwd = getcwd();
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -214,33 +449,155 @@ fork(void)
 
   acquire(&ptable.lock);
 
-  np->state = RUNNABLE;
+  childpush(&g->children, np);
+  setrunnable(np);
+  np->inuser = 1;
 
   release(&ptable.lock);
 
   return pid;
 }
 
+// Create a new thread in the current process, sharing its memory,
+// open files and current directory. The thread starts in user mode
+// at fn(arg), on the stack that ends at stack; fn must not return,
+// but end the thread with exit().
+// Returns the new thread's id, a pid, or -1.
+int
+clone(uint fn, uint arg, uint stack)
+{
+  struct proc *np;
+  struct proc *curproc = myproc();
+  struct proc *g = curproc->group;
+  uint ustack[2];
+
+  ustack[0] = 0xffffffff;  // fake return PC
+  ustack[1] = arg;
+  stack -= sizeof(ustack);
+  if(stack % 4 != 0 ||
+     ((stack >= g->sz || stack + sizeof(ustack) > g->sz) &&
+      mmapcheck(stack, sizeof(ustack)) < 0) ||
+     uvmprefault(stack, sizeof(ustack)) < 0 ||
+     copyout(curproc->pgdir, stack, ustack, sizeof(ustack)) < 0)
+    return -1;
+
+  if((np = allocproc()) == 0)
+    return -1;
+  np->pgdir = curproc->pgdir;
+  np->group = g;
+  np->parent = g;
+  np->nice = curproc->nice;
+  np->pass = curproc->pass;
+  *np->tf = *curproc->tf;
+  np->tf->eip = fn;
+  np->tf->esp = stack;
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  acquire(&ptable.lock);
+  g->nthread++;
+  childpush(&g->threads, np);
+  setrunnable(np);
+  np->inuser = 1;
+  release(&ptable.lock);
+
+  return np->pid;
+}
+
+// Free thread p of a group, which has exited.
+// The ptable lock must be held.
+static void
+reapthread(struct proc *p)
+{
+  childremove(p);
+  kfree(p->kstack);
+  p->kstack = 0;
+  p->pgdir = 0;
+  p->group->nthread--;
+  freeproc(p);
+}
+
+// Wait for thread tid of the current process to exit.
+// Returns tid, or -1 if there is no such thread.
+int
+join(int tid)
+{
+  struct proc *p;
+  struct proc *curproc = myproc();
+  struct proc *g = curproc->group;
+
+  acquire(&ptable.lock);
+  for(;;){
+    p = findproc(tid);
+    if(p == 0 || p->group != g || p == g || p == curproc ||
+       curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+    if(p->state == ZOMBIE){
+      reapthread(p);
+      release(&ptable.lock);
+      return tid;
+    }
+    sleep(g, &ptable.lock);  // see the wakeup1 in exit()
+  }
+}
+
+// Kill the other threads of the current process, which must be
+// their leader, and wait until they have all exited.
+// Returns 0, or -1 if the caller is not the leader.
+int
+killthreads(void)
+{
+  struct proc *g = myproc();
+  struct proc *p, *next;
+
+  if(g->group != g)
+    return -1;
+  acquire(&ptable.lock);
+  while(g->threads){
+    for(p = g->threads; p; p = next){
+      next = p->sibling;
+      if(p->state == ZOMBIE)
+        reapthread(p);
+      else
+        killproc(p);
+    }
+    if(g->threads)
+      sleep(g, &ptable.lock);
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
+// A thread other than the leader exits alone, and waits
+// as a zombie for join(); the leader takes the other
+// threads with it.
 void
 exit(void)
 {
   struct proc *curproc = myproc();
   struct proc *p;
-  int fd;
 
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
+  if(curproc->group != curproc){
+    acquire(&ptable.lock);
+    wakeup1(curproc->group);
+    curproc->state = ZOMBIE;
+    sched();
+    panic("zombie exit");
   }
+  killthreads();
+
+  // Write back and drop mapped files.
+  munmapall(curproc);
+
+  // Close all open files.
+  fdcloseall(curproc);
 
   begin_op();
   iput(curproc->cwd);
@@ -250,15 +607,23 @@ exit(void)
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
+  childremove(curproc);
+  childpush(&curproc->parent->zombies, curproc);
   wakeup1(curproc->parent);
 
   // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
+  while((p = curproc->children) != 0){
+    childremove(p);
+    p->parent = initproc;
+    childpush(&initproc->children, p);
+  }
+  if(curproc->zombies){
+    while((p = curproc->zombies) != 0){
+      childremove(p);
       p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
+      childpush(&initproc->zombies, p);
     }
+    wakeup1(initproc);
   }
 
   // Jump into the scheduler, never to return.
@@ -273,41 +638,32 @@ int
 wait(void)
 {
   struct proc *p;
-  int havekids, pid;
+  int pid;
   struct proc *curproc = myproc();
+  struct proc *g = curproc->group;
   
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
-        continue;
-      havekids = 1;
-      if(p->state == ZOMBIE){
-        // Found one.
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
-        release(&ptable.lock);
-        return pid;
-      }
+    if((p = g->zombies) != 0){
+      // Found one.
+      childremove(p);
+      pid = p->pid;
+      kfree(p->kstack);
+      p->kstack = 0;
+      freevm(p->pgdir);
+      freeproc(p);
+      release(&ptable.lock);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || curproc->killed){
+    if(g->children == 0 || curproc->killed){
       release(&ptable.lock);
       return -1;
     }
 
     // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+    sleep(g, &ptable.lock);  //DOC: wait-sleep
   }
 }
 
@@ -315,7 +671,8 @@ wait(void)
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run
+//  - choose a process to run, from this CPU's run queue
+//    or stolen from another CPU's
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
@@ -330,21 +687,36 @@ scheduler(void)
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
+    if(!runqwaiting(c)){
+      // Nothing to run: halt until an interrupt, which may be the
+      // timer, a device, or another CPU with work (see runqkick).
+      cli();
+      c->idle = 1;
+      __sync_synchronize();
+      if(!runqwaiting(c)){
+        stihlt();
+        kstatinc(KS_IDLEWAKE);
+      }
+      c->idle = 0;
+      continue;
+    }
 
+    acquire(&ptable.lock);
+    if((p = runqpick(c)) != 0){
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
       // before jumping back to us.
       c->proc = p;
       switchuvm(p);
       p->state = RUNNING;
+      p->inuser = 0;
+      kstatinc(KS_CSWITCH);
+      c->tickat = nsnow() + TICKNS;
+      timerarm();
 
+      // The scheduler keeps running on p's page table, which
+      // maps the kernel too, until it picks another process.
       swtch(&(c->scheduler), p->context);
-      switchkvm();
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
@@ -386,7 +758,7 @@ void
 yield(void)
 {
   acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  setrunnable(myproc());
   sched();
   release(&ptable.lock);
 }
@@ -407,6 +779,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -438,6 +811,8 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->wqnext = *waitq(chan);
+  *waitq(chan) = p;
 
   sched();
 
@@ -457,11 +832,17 @@ sleep(void *chan, struct spinlock *lk)
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  struct proc *p, **pp;
+
+  kstatinc(KS_WAKEUP);
+  for(pp = waitq(chan); (p = *pp) != 0; ){
+    kstatinc(KS_WAKEUPSCAN);
+    if(p->chan == chan){
+      *pp = p->wqnext;
+      setrunnable(p);
+    } else
+      pp = &p->wqnext;
+  }
 }
 
 // Wake up all processes sleeping on chan.
@@ -473,27 +854,452 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Sleep until nsnow() reaches when. The deadline goes in this
+// CPU's timer heap (see timer.c). Returns 0, or -1 if killed.
+int
+sleepuntil(uint64 when)
+{
+  struct proc *p = myproc();
+
+  acquire(&ptable.lock);
+  p->wakeat = when;
+  while(nsnow() < when){
+    if(p->killed){
+      timerdel(p);
+      release(&ptable.lock);
+      return -1;
+    }
+    // A CPU whose TSC runs ahead of this one's may have taken
+    // p off its heap already; put it on this CPU's heap again.
+    timerdel(p);
+    timeradd(p);
+    timerarm();
+    sleep(&p->wakeat, &ptable.lock);
+  }
+  timerdel(p);
+  release(&ptable.lock);
+  return 0;
+}
+
+// Wake the processes on this CPU's timer heap whose deadlines
+// are at or before now, and arm the timer for the next one.
+// Called from timer interrupts.
+void
+timerexpire(uint64 now)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  while((p = timerpop(mycpu(), now)) != 0)
+    wakeup1(&p->wakeat);
+  timerarm();
+  release(&ptable.lock);
+}
+
+// Mark p killed, and wake it from sleep if necessary.
+// The ptable lock must be held.
+static void
+killproc(struct proc *p)
+{
+  struct proc **pp;
+
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    for(pp = waitq(p->chan); *pp != p; pp = &(*pp)->wqnext)
+      ;
+    *pp = p->wqnext;
+    setrunnable(p);
+  }
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
+// A thread id kills just that thread.
 int
 kill(int pid)
 {
   struct proc *p;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
+  if((p = findproc(pid)) == 0){
+    release(&ptable.lock);
+    return -1;
+  }
+  killproc(p);
+  release(&ptable.lock);
+  return 0;
+}
+
+// File descriptor tables. A process starts with the NOFILE slots
+// of ofile0, and moves to a page of NOFILEMAX slots when they are
+// all in use; the page goes when the proc is freed. fdmap has a
+// bit set for each fd in use, so that the lowest free fd is found
+// a word at a time. A process with more than one thread changes
+// its table, and looks fds up, under ptable.lock; a process with
+// one thread needs no lock.
+
+static int
+fdlock(struct proc *g)
+{
+  if(g->nthread == 1)
+    return 0;
+  acquire(&ptable.lock);
+  return 1;
+}
+
+static void
+fdunlock(int locked)
+{
+  if(locked)
+    release(&ptable.lock);
+}
+
+// Give p a table of NOFILEMAX slots.
+// Returns 0, or -1 if it has one or there is no memory.
+int
+fdgrow(struct proc *p)
+{
+  struct file **t;
+
+  if(p->nofile != NOFILE || (t = (struct file**)kalloc()) == 0)
+    return -1;
+  memset(t, 0, PGSIZE);
+  memmove(t, p->ofile0, sizeof(p->ofile0));
+  p->ofile = t;
+  p->nofile = NOFILEMAX;
+  return 0;
+}
+
+// Return the file open as fd in the current process, or 0.
+// If the process has other threads, one of them can close fd
+// while the system call uses the file, so it is held by a new
+// reference until the call returns (see fdrelease).
+struct file*
+fdget(int fd)
+{
+  struct proc *curproc = myproc();
+  struct proc *g = curproc->group;
+  struct file *f;
+  int i, locked;
+
+  if(fd < 0)
+    return 0;
+  locked = fdlock(g);
+  f = fd < g->nofile ? g->ofile[fd] : 0;
+  if(f && locked){
+    for(i = 0; i < NELEM(curproc->fdhold) && curproc->fdhold[i]; i++)
+      ;
+    if(i == NELEM(curproc->fdhold))
+      panic("fdget");
+    curproc->fdhold[i] = filedup(f);
+  }
+  fdunlock(locked);
+  return f;
+}
+
+// Drop the files fdget() held for the system call that the
+// current process has just made.
+void
+fdrelease(void)
+{
+  struct proc *curproc = myproc();
+  int i;
+
+  for(i = 0; i < NELEM(curproc->fdhold) && curproc->fdhold[i]; i++){
+    fileclose(curproc->fdhold[i]);
+    curproc->fdhold[i] = 0;
+  }
+}
+
+// Give f the lowest free fd of the current process, growing
+// its table if need be. Takes over the caller's reference
+// to f. Returns the fd, or -1.
+int
+fdalloc(struct file *f)
+{
+  struct proc *g = myproc()->group;
+  uint w, fd;
+  int locked;
+
+  locked = fdlock(g);
+  for(;;){
+    for(w = 0; w*32 < g->nofile; w++){
+      if(g->fdmap[w] == ~0)
+        continue;
+      fd = w*32 + __builtin_ctz(~g->fdmap[w]);
+      if(fd >= g->nofile)
+        break;
+      g->fdmap[w] |= 1 << (fd % 32);
+      g->ofile[fd] = f;
+      fdunlock(locked);
+      return fd;
     }
+    if(fdgrow(g) < 0){
+      fdunlock(locked);
+      return -1;
+    }
+  }
+}
+
+// Take fd out of the current process's table.
+// Returns the file it was, for the caller to close, or 0.
+struct file*
+fdremove(int fd)
+{
+  struct proc *g = myproc()->group;
+  struct file *f;
+  int locked;
+
+  if(fd < 0)
+    return 0;
+  locked = fdlock(g);
+  f = 0;
+  if(fd < g->nofile && (f = g->ofile[fd]) != 0){
+    g->ofile[fd] = 0;
+    g->fdmap[fd / 32] &= ~(1 << (fd % 32));
+  }
+  fdunlock(locked);
+  return f;
+}
+
+// Give np, being created by fork(), the open files of g.
+// np's table is grown to the size of g's under the same lock
+// as the copy, since another thread of g may be growing it.
+// Returns 0, or -1 if there is no memory.
+static int
+fdfork(struct proc *np, struct proc *g)
+{
+  int locked;
+  uint fd;
+
+  locked = fdlock(g);
+  if(g->nofile > np->nofile && fdgrow(np) < 0){
+    fdunlock(locked);
+    return -1;
+  }
+  for(fd = 0; fd < g->nofile; fd++)
+    if(g->ofile[fd])
+      np->ofile[fd] = filedup(g->ofile[fd]);
+  memmove(np->fdmap, g->fdmap, sizeof(g->fdmap));
+  fdunlock(locked);
+  return 0;
+}
+
+// Close all the open files of p, whose other threads are gone.
+static void
+fdcloseall(struct proc *p)
+{
+  uint fd;
+
+  for(fd = 0; fd < p->nofile; fd++){
+    if(p->ofile[fd]){
+      fileclose(p->ofile[fd]);
+      p->ofile[fd] = 0;
+    }
+  }
+  memset(p->fdmap, 0, sizeof(p->fdmap));
+}
+
+// Return a new reference to the current directory of the
+// current process. Another of its threads may be changing it
+// (see setcwd); a process with one thread needs no lock.
+struct inode*
+getcwd(void)
+{
+  struct proc *g = myproc()->group;
+  struct inode *ip;
+
+  if(g->nthread == 1)
+    return idup(g->cwd);
+  acquire(&ptable.lock);
+  ip = idup(g->cwd);
+  release(&ptable.lock);
+  return ip;
+}
+
+// Make ip, a referenced inode, the current directory
+// of the current process.
+void
+setcwd(struct inode *ip)
+{
+  struct proc *g = myproc()->group;
+  struct inode *old;
+
+  acquire(&ptable.lock);
+  old = g->cwd;
+  g->cwd = ip;
+  release(&ptable.lock);
+  iput(old);
+}
+
+// Futexes let processes sleep on a word of memory until another
+// wakes them. futexwait() sleeps only if the word still holds val,
+// which it checks under ptable.lock; futexwake() takes the lock too,
+// so no wakeup can come between the check and the sleep.
+//
+// A futex is named by the physical address of its word, so that
+// threads and processes sharing the page (a MAP_SHARED mapping of
+// one file, say) find the same one wherever each maps it. A waiter
+// sleeps on the kernel address of the word; p->futex tells its
+// sleep from the kernel's own sleeps on that address.
+
+// Return the kernel address of the int at user address addr of
+// the current process, or 0 if it is not mapped.
+static int*
+futexkey(uint addr)
+{
+  char *k;
+
+  if(addr % 4 != 0)
+    return 0;
+  if((k = uva2ka(myproc()->pgdir, (char*)addr)) == 0)
+    return 0;
+  return (int*)(k + addr % PGSIZE);
+}
+
+// Sleep on the futex at user address addr if it holds val.
+// Returns 0 when woken, -1 if it did not hold val or the
+// process has been killed.
+int
+futexwait(uint addr, int val)
+{
+  struct proc *p = myproc();
+  int *w;
+
+  // A copy-on-write page is copied first, so that the
+  // word's page is the process's own.
+  if(uvmunshare(addr) < 0)
+    return -1;
+  acquire(&ptable.lock);
+  if((w = futexkey(addr)) == 0 || *w != val || p->killed){
+    release(&ptable.lock);
+    return -1;
+  }
+  p->futex = 1;
+  sleep(w, &ptable.lock);
+  p->futex = 0;
+  release(&ptable.lock);
+  return 0;
+}
+
+// Wake up to n processes sleeping on the futex at user address
+// addr. Returns how many were woken.
+int
+futexwake(uint addr, int n)
+{
+  struct proc *p, **pp;
+  int *w, woken;
+
+  if(uvmunshare(addr) < 0)
+    return -1;
+  woken = 0;
+  acquire(&ptable.lock);
+  if((w = futexkey(addr)) == 0){
+    release(&ptable.lock);
+    return -1;
+  }
+  for(pp = waitq(w); woken < n && (p = *pp) != 0; ){
+    if(p->chan == w && p->futex){
+      *pp = p->wqnext;
+      setrunnable(p);
+      woken++;
+    } else
+      pp = &p->wqnext;
+  }
+  release(&ptable.lock);
+  return woken;
+}
+
+// Set the nice value of the process with the given pid,
+// clamped to NICE_MIN..NICE_MAX. Returns 0, or -1 if there
+// is no such process.
+int
+setpriority(int pid, int nice)
+{
+  struct proc *p;
+
+  if(nice < NICE_MIN)
+    nice = NICE_MIN;
+  if(nice > NICE_MAX)
+    nice = NICE_MAX;
+  acquire(&ptable.lock);
+  if((p = findproc(pid)) == 0){
+    release(&ptable.lock);
+    return -1;
+  }
+  p->nice = nice;
+  if(p->state == RUNNABLE){
+    // It may belong on another level now.
+    runqremove(p);
+    runqput(p);
   }
   release(&ptable.lock);
-  return -1;
+  return 0;
+}
+
+// Switch to scheduling policy pol (see sched.h).
+// Returns the previous policy, or -1 if pol is not one.
+int
+setsched(int pol)
+{
+  int old;
+
+  acquire(&ptable.lock);
+  old = schedswitch(pol);
+  release(&ptable.lock);
+  return old;
+}
+
+// Pick a user page to be swapped out to slot, by running a clock
+// over the address spaces of RUNNABLE processes that were preempted
+// in user mode (see swapscan() in vm.c), and of the current process
+// if it is handling a page fault from user mode. Processes in a
+// system call are left alone, the current one too, since they may
+// be using memory that checkptr() faulted in under a spinlock. The page's PTE is changed
+// to refer to slot before returning, so that its owner faults if
+// it touches the page again; the caller writes the page out and
+// frees it. Returns the page, or 0 if there is none to take.
+char*
+swapvictim(uint slot)
+{
+  static struct proc *hand;
+  static uint handva;
+  struct proc *p;
+  pte_t *pte;
+  char *mem;
+  int n;
+
+  acquire(&ptable.lock);
+  // Two times round, since the first may only clear PTE_A bits.
+  for(n = 0; n <= 2*ptable.nproc; n++){
+    if(hand == 0)
+      hand = ptable.all;
+    p = hand;
+    // Threads share their page table, and may be running
+    // on other CPUs; leave them alone.
+    if(p->pgdir && p->nthread == 1 && p->group == p &&
+       ((p == myproc() && p->tf->trapno == T_PGFLT) ||
+        (p->state == RUNNABLE && p->inuser))){
+      pte = swapscan(p->pgdir, &handva, p->sz);
+      // Its TLB entries on other CPUs may be stale now.
+      p->cpu = 0;
+      if(pte){
+        mem = P2V(PTE_ADDR(*pte));
+        *pte = (slot << PGSHIFT) | PTE_SWAP |
+               (PTE_FLAGS(*pte) & ~(PTE_P|PTE_A|PTE_D));
+        if(p == myproc())
+          invlpg((void*)handva);
+        handva += PGSIZE;
+        release(&ptable.lock);
+        return mem;
+      }
+    }
+    hand = hand->allnext;
+    handva = 0;
+  }
+  release(&ptable.lock);
+  return 0;
 }
 
 //PAGEBREAK: 36
@@ -516,7 +1322,7 @@ procdump(void)
   char *state;
   uint pc[10];
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = ptable.all; p; p = p->allnext){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -1,3 +1,5 @@
+#define NRUNQ 8                // Run queue levels (see sched.c)
+
 // Per-CPU state
 struct cpu {
   uchar apicid;                // Local APIC ID
@@ -8,6 +10,21 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  pde_t *pgdir;                // Page table in cr3, or 0 for kpgdir
+  int pgdirfree;               // pgdir was freed while loaded (see freevm)
+  struct proc *runq[NRUNQ];    // RUNNABLE processes waiting for this cpu
+  struct proc *runqtail[NRUNQ];
+  volatile int nrunq;          // Processes in runq
+  uint minpass;                // Stride pass of the last process taken
+  uint epoch;                  // MLFQ boost period of the queue
+  struct proc *timers[NPROC];  // Heap of processes in sleepuntil()
+  int ntimer;                  // Processes in timers
+  uint64 timerat;              // When the LAPIC timer fires, or 0 if off
+  uint64 tickat;               // Next scheduling tick of c->proc
+  volatile int idle;           // Halted, waiting for work
+  volatile int tlbflush;       // Asked to flush its TLB now
+  int tlbstale;                // TLB may be stale for pgdir: reload cr3
+  uint nsyscall;               // System calls made on this cpu
 };
 
 extern struct cpu cpus[NCPU];
@@ -32,9 +49,22 @@ struct context {
   uint eip;
 };
 
+// A region of a file mapped with mmap() (see mmap.c).
+struct vma {
+  uint start;                  // First address, page-aligned; 0 if unused
+  uint end;                    // One past the last address, page-aligned
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE
+  struct file *f;              // Mapped file
+  uint off;                    // File offset mapped at start
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
-// Per-process state
+// Per-process state. A process may have more threads, created by
+// clone(), which share its page table. The first thread, the group
+// leader, holds the state they share: sz, hugeheap, vma, ofile and
+// cwd are only used in the leader.
 struct proc {
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
@@ -46,8 +76,39 @@ struct proc {
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
+  struct file **ofile;         // Open files: ofile0, or a page once grown
+  int nofile;                  // Slots in ofile
+  uint fdmap[NOFILEMAX/32];    // Bitmap of the fds in use
+  struct file *ofile0[NOFILE]; // Open files, until the table grows
+  struct file *fdhold[2];      // Files fdget() holds for this system call
   struct inode *cwd;           // Current directory
+  struct vma vma[NVMA];        // Mapped files
+  int hugeheap;                // If non-zero, sbrk() uses 4MB pages
+  struct cpu *cpu;             // CPU this process last ran on
+  int inuser;                  // RUNNABLE and not in a system call
+  struct cpu *home;            // CPU whose run queue it joins
+  struct proc *rqnext;         // Next in that run queue
+  int rqlevel;                 // Level of that run queue it is in
+  int nice;                    // NICE_MIN..NICE_MAX (see sched.h)
+  int tickused;                // Ticks run of its current quantum
+  int level;                   // MLFQ level
+  uint epoch;                  // MLFQ boost period of level
+  uint pass;                   // Stride scheduling pass
+  uint64 wakeat;               // Deadline in sleepuntil()
+  struct cpu *timercpu;        // CPU whose timer heap it is in, or 0
+  int timeridx;                // Index in that heap
+  struct proc *wqnext;         // Next in its wait queue, if SLEEPING
+  struct proc *next;           // Next in its pid hash chain, or free list
+  struct proc *allnext;        // Next of all procs (see allocproc)
+  struct proc *children;       // Children that have not exited
+  struct proc *zombies;        // Children that have exited
+  struct proc *sibling;        // Next in its parent's children or zombies
+  struct proc **psibling;      // What points to it in that list
+  struct proc *group;          // Thread group leader; itself for a process
+  struct proc *threads;        // Other threads of the group, if leader
+  int nthread;                 // Threads in the group, if leader
+  int mmbusy;                  // Memory layout being changed, if leader
+  int futex;                   // Sleeping in futexwait()
   char name[16];               // Process name (debugging)
 };
 
@@ -56,3 +117,5 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+//   ...
+//   mapped files (from MMAPBASE up)
@@ -0,0 +1,72 @@
+// Process table benchmark. Forks and reaps NCHILD children, one at
+// a time, first with nothing else running and then with NIDLE more
+// children asleep, filling the process table, to show that fork,
+// exit and wait do not get slower as the table fills. Reports the
+// time per fork/exit/wait, and the kill() rate of a missing pid.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NCHILD 10000
+#define NIDLE  200
+#define NKILL  10000
+
+void
+storm(char *what)
+{
+  int i, pid, t0, t;
+
+  t0 = uptime();
+  for(i = 0; i < NCHILD; i++){
+    if((pid = fork()) < 0){
+      printf(1, "procbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0)
+      exit();
+    if(wait() != pid){
+      printf(1, "procbench: wait returned the wrong pid\n");
+      exit();
+    }
+  }
+  t = uptime() - t0;
+  printf(1, "procbench: %s: %d forks in %d ms, %d us each\n",
+         what, NCHILD, t * 10, t * 10000 / NCHILD);
+
+  t0 = uptime();
+  for(i = 0; i < NKILL; i++)
+    kill(1000000 + i);
+  t = uptime() - t0;
+  printf(1, "procbench: %s: %d kills of a missing pid in %d ms\n",
+         what, NKILL, t * 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, fd[2];
+  char c;
+
+  storm("empty table");
+
+  pipe(fd);
+  for(n = 0; n < NIDLE; n++){
+    i = fork();
+    if(i < 0)
+      break;
+    if(i == 0){
+      close(fd[1]);
+      read(fd[0], &c, 1);
+      exit();
+    }
+  }
+  close(fd[0]);
+  printf(1, "procbench: %d idle children\n", n);
+  storm("full table");
+
+  close(fd[1]);
+  for(i = 0; i < n; i++)
+    wait();
+  exit();
+}
@@ -0,0 +1,104 @@
+// Parallel readers benchmark. 1, 2, 4 and 8 processes read the
+// same large file at once, each through its own open file, over and
+// over. The file is mapped and touched first, so that its pages are
+// in the page cache and the readers wait for each other's locks and
+// not for the disk. Reports the total read rate and its speedup
+// over a single reader.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+#define FILESIZE (256*1024)
+#define RUNTICKS 200
+#define HZ       100   // timer ticks per second
+
+char *path = "readbench.tmp";
+char buf[4096];
+
+int
+mkfile(void)
+{
+  int fd, i;
+  char *p;
+
+  if((fd = open(path, O_CREATE|O_RDWR)) < 0)
+    return -1;
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i%26;
+  for(i = 0; i < FILESIZE; i += sizeof(buf))
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      close(fd);
+      return -1;
+    }
+  p = mmap(0, FILESIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(p != (char*)-1){
+    for(i = 0; i < FILESIZE; i += 4096)
+      buf[0] += p[i];
+    munmap(p, FILESIZE);
+  }
+  close(fd);
+  return 0;
+}
+
+int
+run(int nproc)
+{
+  int i, n, kb, total, fd, pfd[2], t0;
+
+  pipe(pfd);
+  t0 = uptime();
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0){
+      close(pfd[0]);
+      fd = open(path, O_RDONLY);
+      kb = 0;
+      while(uptime() - t0 < RUNTICKS){
+        if((n = read(fd, buf, sizeof(buf))) <= 0){
+          close(fd);
+          fd = open(path, O_RDONLY);
+          continue;
+        }
+        kb += n / 1024;
+      }
+      close(fd);
+      write(pfd[1], &kb, sizeof(kb));
+      exit();
+    }
+  }
+  close(pfd[1]);
+  total = 0;
+  for(i = 0; i < nproc; i++){
+    if(read(pfd[0], &kb, sizeof(kb)) == sizeof(kb))
+      total += kb;
+    wait();
+  }
+  close(pfd[0]);
+  return total * HZ / RUNTICKS;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, rate, base;
+
+  if(mkfile() < 0){
+    printf(1, "readbench: cannot create %s\n", path);
+    exit();
+  }
+  printf(1, "readbench: %d CPUs, %d KB file\n", kstat(KS_NCPU),
+         FILESIZE / 1024);
+  base = 0;
+  for(n = 1; n <= 8; n *= 2){
+    rate = run(n);
+    if(n == 1)
+      base = rate ? rate : 1;
+    printf(1, "readbench: %d readers: %d KB/s, speedup %d.%d%d\n",
+           n, rate, rate / base, rate * 10 / base % 10,
+           rate * 100 / base % 10);
+  }
+  unlink(path);
+  exit();
+}
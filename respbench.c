@@ -0,0 +1,118 @@
+// Response-time benchmark. Under each scheduling policy, starts
+// CPU hogs at the lowest priority (two per CPU) and then measures,
+// NSAMPLE times, how long an interactive process takes to answer a
+// byte sent to it through a pipe. Between samples the prober sleeps
+// for a tick, so that the hogs get the CPUs back. Reports
+// percentiles of the response time, in thousands of TSC cycles.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+#include "sched.h"
+
+#define NSAMPLE 200
+#define MAXHOG  16
+
+char *names[NSCHED] = {
+[SCHED_RR]     "round robin",
+[SCHED_MLFQ]   "mlfq",
+[SCHED_STRIDE] "stride",
+[SCHED_PRIO]   "priority",
+};
+
+uint samples[NSAMPLE];
+
+static inline uint
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return lo;
+}
+
+void
+sort(uint *a, int n)
+{
+  int i, j;
+  uint x;
+
+  for(i = 1; i < n; i++){
+    x = a[i];
+    for(j = i; j > 0 && a[j-1] > x; j--)
+      a[j] = a[j-1];
+    a[j] = x;
+  }
+}
+
+void
+measure(int pol)
+{
+  int hogs[MAXHOG], nhog, to[2], from[2], i, echo;
+  volatile int spin;
+  uint t0;
+  char c;
+
+  if(setsched(pol) < 0){
+    printf(1, "respbench: setsched %d failed\n", pol);
+    return;
+  }
+
+  nhog = 2 * kstat(KS_NCPU);
+  if(nhog > MAXHOG)
+    nhog = MAXHOG;
+  for(i = 0; i < nhog; i++){
+    if((hogs[i] = fork()) == 0){
+      nice(NICE_MAX);
+      for(spin = 0; ; spin++)
+        ;
+    }
+  }
+
+  pipe(to);
+  pipe(from);
+  if((echo = fork()) == 0){
+    close(to[1]);
+    close(from[0]);
+    while(read(to[0], &c, 1) == 1)
+      write(from[1], &c, 1);
+    exit();
+  }
+  close(to[0]);
+  close(from[1]);
+
+  sleep(20);   // let the hogs settle, and sink in MLFQ
+  for(i = 0; i < NSAMPLE; i++){
+    sleep(1);
+    t0 = rdtsc();
+    write(to[1], "x", 1);
+    read(from[0], &c, 1);
+    samples[i] = (rdtsc() - t0) / 1000;
+  }
+  close(to[1]);
+  close(from[0]);
+  wait();
+
+  for(i = 0; i < nhog; i++)
+    kill(hogs[i]);
+  for(i = 0; i < nhog; i++)
+    wait();
+
+  sort(samples, NSAMPLE);
+  printf(1, "respbench: %s: kcycles p50 %d p90 %d p99 %d max %d\n",
+         names[pol], samples[NSAMPLE/2], samples[NSAMPLE*9/10],
+         samples[NSAMPLE*99/100], samples[NSAMPLE-1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pol, old;
+
+  old = setsched(SCHED_RR);
+  for(pol = 0; pol < NSCHED; pol++)
+    measure(pol);
+  setsched(old);
+  exit();
+}
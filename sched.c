@@ -0,0 +1,314 @@
+// Run queues and scheduling policies.
+//
+// Each CPU has a queue of the RUNNABLE processes waiting for it.
+// A process joins the queue of the CPU it last ran on (its home), so
+// it tends to find its cache and TLB entries still warm; a CPU whose
+// queue is empty steals from the longest queue of another CPU.
+//
+// A queue has NRUNQ levels, and a CPU runs the head of the first
+// non-empty level. The policy, chosen with setsched(), decides which
+// level a process joins and how many ticks it runs before the timer
+// makes it yield (see struct policy):
+//
+//   SCHED_RR      one level, one tick at a time: plain round robin.
+//   SCHED_MLFQ    a process starts at level 0 and moves down a level
+//                 each time it uses up its quantum, which doubles at
+//                 each level down. Every MLFQBOOST ticks all of them
+//                 go back to level 0, so that hogs are not starved.
+//   SCHED_STRIDE  one level, kept sorted by pass. Each tick a process
+//                 runs adds STRIDE1/tickets to its pass, and lower
+//                 nice values get more tickets, so processes share
+//                 the CPU in proportion to their tickets.
+//   SCHED_PRIO    the level follows the nice value, strictly.
+//
+// Under MLFQ and PRIO a process also yields at the next tick if a
+// higher level of its CPU's queue is not empty.
+//
+// The queues are protected by ptable.lock, which the callers hold.
+// schedtick() touches only the running process, and idle CPUs look
+// at the queue lengths without the lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "traps.h"
+#include "sched.h"
+#include "kstat.h"
+
+#define NMLFQ      4     // MLFQ levels
+#define MLFQBOOST  100   // ticks between MLFQ boosts
+#define STRIDE1    (1 << 16)
+
+struct policy {
+  int (*level)(struct proc*);     // queue level p joins
+  int (*quantum)(struct proc*);   // ticks p runs before yielding
+  void (*expire)(struct proc*);   // p used up its quantum, or 0
+  void (*tick)(struct proc*);     // p ran for a tick, or 0
+  int ordered;                    // levels sorted by pass, not FIFO
+};
+
+static int
+level0(struct proc *p)
+{
+  return 0;
+}
+
+static int
+onetick(struct proc *p)
+{
+  return 1;
+}
+
+static int
+mlfqlevel(struct proc *p)
+{
+  if(p->epoch != ticks / MLFQBOOST){
+    p->epoch = ticks / MLFQBOOST;
+    p->level = 0;
+  }
+  return p->level;
+}
+
+static int
+mlfqquantum(struct proc *p)
+{
+  return 1 << mlfqlevel(p);
+}
+
+static void
+mlfqexpire(struct proc *p)
+{
+  if(p->level < NMLFQ-1)
+    p->level++;
+}
+
+static void
+stridetick(struct proc *p)
+{
+  p->pass += STRIDE1 / (NICE_MAX + 1 - p->nice);
+}
+
+static int
+priolevel(struct proc *p)
+{
+  return (p->nice - NICE_MIN) * NRUNQ / (NICE_MAX - NICE_MIN + 1);
+}
+
+static struct policy policies[NSCHED] = {
+[SCHED_RR]     { level0, onetick, 0, 0, 0 },
+[SCHED_MLFQ]   { mlfqlevel, mlfqquantum, mlfqexpire, 0, 0 },
+[SCHED_STRIDE] { level0, onetick, 0, stridetick, 1 },
+[SCHED_PRIO]   { priolevel, onetick, 0, 0, 0 },
+};
+
+static int schedpolicy = SCHED_RR;
+static struct policy *policy = &policies[SCHED_RR];
+
+// Put RUNNABLE p into the queue of its home CPU.
+void
+runqput(struct proc *p)
+{
+  struct cpu *c = p->home;
+  struct proc **pp;
+  int l;
+
+  l = policy->level(p);
+  p->rqlevel = l;
+  p->rqnext = 0;
+  if(policy->ordered){
+    // A process that slept must not catch up all at once.
+    if((int)(p->pass - c->minpass) < 0)
+      p->pass = c->minpass;
+    for(pp = &c->runq[l]; *pp; pp = &(*pp)->rqnext)
+      if((int)(p->pass - (*pp)->pass) < 0)
+        break;
+    p->rqnext = *pp;
+    *pp = p;
+    if(p->rqnext == 0)
+      c->runqtail[l] = p;
+  } else {
+    if(c->runq[l] == 0)
+      c->runq[l] = p;
+    else
+      c->runqtail[l]->rqnext = p;
+    c->runqtail[l] = p;
+  }
+  c->nrunq++;
+}
+
+// Take p, which is RUNNABLE, out of its home CPU's queue.
+void
+runqremove(struct proc *p)
+{
+  struct cpu *c = p->home;
+  struct proc **pp, *prev;
+
+  prev = 0;
+  for(pp = &c->runq[p->rqlevel]; *pp != p; pp = &(*pp)->rqnext){
+    if(*pp == 0)
+      panic("runqremove");
+    prev = *pp;
+  }
+  *pp = p->rqnext;
+  if(c->runqtail[p->rqlevel] == p)
+    c->runqtail[p->rqlevel] = prev;
+  c->nrunq--;
+  p->rqnext = 0;
+}
+
+// Take the first process of c's queue, or return 0.
+static struct proc*
+runqget(struct cpu *c)
+{
+  struct proc *p;
+  int l;
+
+  for(l = 0; l < NRUNQ; l++)
+    if((p = c->runq[l]) != 0)
+      break;
+  if(l == NRUNQ)
+    return 0;
+  c->runq[l] = p->rqnext;
+  if(c->runq[l] == 0)
+    c->runqtail[l] = 0;
+  c->nrunq--;
+  p->rqnext = 0;
+  if(policy->ordered)
+    c->minpass = p->pass;
+  return p;
+}
+
+// Empty c's queue and put the processes back in, as the
+// policy now says.
+static void
+requeue(struct cpu *c)
+{
+  struct proc *list, *p;
+  int l;
+
+  list = 0;
+  for(l = NRUNQ-1; l >= 0; l--){
+    if(c->runq[l]){
+      c->runqtail[l]->rqnext = list;
+      list = c->runq[l];
+    }
+    c->runq[l] = c->runqtail[l] = 0;
+  }
+  c->nrunq = 0;
+  while((p = list) != 0){
+    list = p->rqnext;
+    runqput(p);
+  }
+}
+
+// A process was just put in c's queue. If c is idle, wake it;
+// if c is busy, wake some idle CPU to steal the process.
+// Nothing to do if this CPU is idle: it is in an interrupt
+// handler and will look at the queues on the way out.
+void
+runqkick(struct cpu *c)
+{
+  struct cpu *d, *me = mycpu();
+
+  if(me->proc == 0)
+    return;
+  __sync_synchronize();   // pairs with the one in scheduler()
+  if(c->idle){
+    if(c != me)
+      lapicipi(c->apicid, T_IRQ0 + IRQ_WAKE);
+    return;
+  }
+  for(d = cpus; d < &cpus[ncpu]; d++){
+    if(d != me && d->idle){
+      lapicipi(d->apicid, T_IRQ0 + IRQ_WAKE);
+      return;
+    }
+  }
+}
+
+// Find the CPU with the longest queue other than c, or 0
+// if they are all empty. Needs no lock; the caller rechecks.
+static struct cpu*
+busiest(struct cpu *c)
+{
+  struct cpu *d, *best;
+
+  best = 0;
+  for(d = cpus; d < &cpus[ncpu]; d++)
+    if(d != c && d->nrunq > 0 && (best == 0 || d->nrunq > best->nrunq))
+      best = d;
+  return best;
+}
+
+// Is there anything for c to run? Needs no lock.
+int
+runqwaiting(struct cpu *c)
+{
+  return c->nrunq > 0 || busiest(c) != 0;
+}
+
+// Pick the next process for c to run: from its own queue, or
+// else stolen from another CPU's, in which case c becomes the
+// process's home.
+struct proc*
+runqpick(struct cpu *c)
+{
+  struct proc *p;
+  struct cpu *d;
+
+  if(schedpolicy == SCHED_MLFQ && c->epoch != ticks / MLFQBOOST){
+    c->epoch = ticks / MLFQBOOST;
+    requeue(c);
+  }
+  if((p = runqget(c)) != 0)
+    return p;
+  if((d = busiest(c)) == 0 || (p = runqget(d)) == 0)
+    return 0;
+  p->home = c;
+  kstatinc(KS_STEAL);
+  return p;
+}
+
+// The timer ticked while p was running on this CPU.
+// Returns 1 if p should yield.
+int
+schedtick(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  int l, pl;
+
+  if(policy->tick)
+    policy->tick(p);
+  if(++p->tickused >= policy->quantum(p)){
+    p->tickused = 0;
+    if(policy->expire)
+      policy->expire(p);
+    return 1;
+  }
+  pl = policy->level(p);
+  for(l = 0; l < pl; l++)
+    if(c->runq[l])
+      return 1;
+  return 0;
+}
+
+// Switch to scheduling policy pol (see sched.h).
+// Returns the previous policy, or -1 if pol is not one.
+int
+schedswitch(int pol)
+{
+  struct cpu *c;
+  int old;
+
+  if(pol < 0 || pol >= NSCHED)
+    return -1;
+  old = schedpolicy;
+  schedpolicy = pol;
+  policy = &policies[pol];
+  for(c = cpus; c < &cpus[ncpu]; c++)
+    requeue(c);
+  return old;
+}
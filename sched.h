@@ -0,0 +1,12 @@
+// Scheduling policies, chosen with setsched(), and nice values,
+// set with nice() and setpriority().
+// Both the kernel and user programs use this header file.
+
+#define SCHED_RR      0   // round robin, one tick at a time
+#define SCHED_MLFQ    1   // multilevel feedback queue
+#define SCHED_STRIDE  2   // stride scheduling: CPU share by nice value
+#define SCHED_PRIO    3   // static priority by nice value
+#define NSCHED        4
+
+#define NICE_MIN    -20   // highest priority
+#define NICE_MAX     19   // lowest priority
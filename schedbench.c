@@ -0,0 +1,111 @@
+// Scheduler benchmark. For 1 to 8 processes, runs
+//  - CPU-bound loops, counting the switches the timer forces, and
+//  - ping-pong pairs passing a byte back and forth through pipes,
+//    counting round trips,
+// and reports context switches per second and how many processes
+// idle CPUs stole from busy ones. Boot with CPUS=1 to 8 to vary
+// the number of CPUs (make qemu CPUS=4).
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+#define RUNTICKS 200
+#define HZ       100   // timer interrupts per second
+
+// Spin until RUNTICKS have passed since t0.
+void
+spin(int t0)
+{
+  volatile int i;
+
+  while(uptime() - t0 < RUNTICKS)
+    for(i = 0; i < 10000; i++)
+      ;
+}
+
+// Bounce a byte between this process and a child of it until
+// RUNTICKS have passed since t0. Returns the round trips made.
+int
+pingpong(int t0)
+{
+  int p1[2], p2[2], pid, n;
+  char c;
+
+  pipe(p1);
+  pipe(p2);
+  pid = fork();
+  if(pid == 0){
+    close(p1[1]);
+    close(p2[0]);
+    while(read(p1[0], &c, 1) == 1)
+      write(p2[1], &c, 1);
+    exit();
+  }
+  close(p1[0]);
+  close(p2[1]);
+  for(n = 0; uptime() - t0 < RUNTICKS; n++){
+    write(p1[1], "x", 1);
+    if(read(p2[0], &c, 1) != 1)
+      break;
+  }
+  close(p1[1]);
+  close(p2[0]);
+  wait();
+  return n;
+}
+
+// Run n copies of a workload at once and report on them.
+// Each ping-pong copy is a pair of processes.
+void
+run(char *what, int n, int pp)
+{
+  int i, t0, t, cs0, st0, fd[2], trips, k;
+
+  pipe(fd);
+  cs0 = kstat(KS_CSWITCH);
+  st0 = kstat(KS_STEAL);
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(fork() == 0){
+      close(fd[0]);
+      k = 0;
+      if(pp)
+        k = pingpong(t0);
+      else
+        spin(t0);
+      write(fd[1], &k, sizeof(k));
+      exit();
+    }
+  }
+  close(fd[1]);
+  trips = 0;
+  for(i = 0; i < n; i++){
+    if(read(fd[0], &k, sizeof(k)) == sizeof(k))
+      trips += k;
+    wait();
+  }
+  close(fd[0]);
+  t = uptime() - t0;
+  if(t == 0)
+    t = 1;
+  printf(1, "schedbench: %s x%d: %d switches/s, %d steals",
+         what, n, (kstat(KS_CSWITCH) - cs0) * HZ / t, kstat(KS_STEAL) - st0);
+  if(pp)
+    printf(1, ", %d round trips/s", trips * HZ / t);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  printf(1, "schedbench: %d CPUs\n", kstat(KS_NCPU));
+  for(n = 1; n <= 8; n *= 2)
+    run("cpu-bound", n, 0);
+  for(n = 1; n <= 8; n *= 2)
+    run("ping-pong", n, 1);
+  exit();
+}
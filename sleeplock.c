@@ -1,4 +1,17 @@
 // Sleeping locks
+//
+// Sleep locks are adaptive: a process that finds one held spins
+// for a while first, as long as the holder is running on another
+// CPU, since the holder will usually let go sooner than a sleep
+// and a wakeup would take. If the holder is not running, or takes
+// too long, it sleeps. releasesleep() calls wakeup() only if
+// someone is asleep.
+//
+// A sleep lock can also be held shared, by any number of readers
+// at once (acquiresleep_shared()), as long as no one holds it
+// exclusively. A process waiting to hold it exclusively keeps new
+// readers out, so that a stream of readers cannot starve it; so a
+// process must never take the same lock shared twice.
 
 #include "types.h"
 #include "defs.h"
@@ -9,6 +22,9 @@
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "kstat.h"
+
+#define SPINCYCLES 100000   // TSC cycles to spin before sleeping
 
 void
 initsleeplock(struct sleeplock *lk, char *name)
@@ -16,19 +32,79 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->owner = 0;
+  lk->nwaiter = 0;
+  lk->nreader = 0;
+  lk->nwriter = 0;
   lk->pid = 0;
 }
 
+// Spin while lk is held exclusively by a running process.
+// Returns whether it was held at all.
+static int
+spinsleep(struct sleeplock *lk)
+{
+  struct proc *owner;
+  uint t0;
+
+  if(!lk->locked)
+    return 0;
+  t0 = rdtsc();
+  while(lk->locked && (owner = lk->owner) != 0 &&
+        owner->state == RUNNING && rdtsc() - t0 < SPINCYCLES)
+    pause();
+  return 1;
+}
+
+static void
+countsleep(int held, int slept)
+{
+  if(slept)
+    kstatinc(KS_SLEEPLOCKSLEEP);
+  else if(held)
+    kstatinc(KS_SLEEPLOCKSPIN);
+}
+
 void
 acquiresleep(struct sleeplock *lk)
 {
+  int held, slept;
+
+  held = spinsleep(lk);
   acquire(&lk->lk);
-  while (lk->locked) {
+  slept = 0;
+  while (lk->locked || lk->nreader > 0) {
+    lk->nwaiter++;
+    lk->nwriter++;
     sleep(lk, &lk->lk);
+    lk->nwriter--;
+    lk->nwaiter--;
+    slept = 1;
   }
   lk->locked = 1;
+  lk->owner = myproc();
   lk->pid = myproc()->pid;
   release(&lk->lk);
+  countsleep(held, slept);
+}
+
+void
+acquiresleep_shared(struct sleeplock *lk)
+{
+  int held, slept;
+
+  held = spinsleep(lk);
+  acquire(&lk->lk);
+  slept = 0;
+  while (lk->locked || lk->nwriter > 0) {
+    lk->nwaiter++;
+    sleep(lk, &lk->lk);
+    lk->nwaiter--;
+    slept = 1;
+  }
+  lk->nreader++;
+  release(&lk->lk);
+  countsleep(held, slept);
 }
 
 void
@@ -36,8 +112,21 @@ releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
-  wakeup(lk);
+  if(lk->nwaiter > 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+void
+releasesleep_shared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->nreader < 1)
+    panic("releasesleep_shared");
+  if(--lk->nreader == 0 && lk->nwaiter > 0)
+    wakeup(lk);
   release(&lk->lk);
 }
 
@@ -52,5 +141,14 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
+// Is lk held shared, by anyone?
+int
+holdingsleep_shared(struct sleeplock *lk)
+{
+  int r;
 
-
+  acquire(&lk->lk);
+  r = lk->nreader > 0;
+  release(&lk->lk);
+  return r;
+}
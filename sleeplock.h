@@ -1,7 +1,11 @@
 // Long-term locks for processes
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  volatile uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
+  struct proc *volatile owner; // Process holding lock
+  int nwaiter;        // Processes asleep waiting for it
+  int nreader;        // Processes holding it shared
+  int nwriter;        // Processes waiting to hold it exclusively
   
   // For debugging:
   char *name;        // Name of lock.
@@ -1,4 +1,15 @@
 // Mutual exclusion spin locks.
+//
+// These are ticket locks: acquire() takes the next ticket with an
+// atomic add and waits until the owner field reaches it, and
+// release() moves the owner on. Waiters only read the lock while
+// they spin, and get it in the order they arrived.
+//
+// Each lock counts its acquisitions, the ones that had to wait, and
+// the cycles spent waiting. Locks outside allocated memory (those
+// of the kernel's data and bss) are registered by initlock(), so
+// that lockstat() can report them to user space.
+// Build with -DLOCKDEBUG to record the caller of each acquisition.
 
 #include "types.h"
 #include "defs.h"
@@ -8,13 +19,34 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+#define NLOCKREG 256
+
+extern char end[];   // first address after kernel loaded from ELF file
+
+static struct spinlock *locks[NLOCKREG];   // registered locks
+static uint nlocks;
 
 void
 initlock(struct spinlock *lk, char *name)
 {
+  uint i;
+
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->nacquire = 0;
+  lk->ncontend = 0;
+  lk->spincycles = 0;
+  if((char*)lk < end){
+    for(i = 0; i < nlocks; i++)
+      if(locks[i] == lk)
+        return;
+    if((i = __sync_fetch_and_add(&nlocks, 1)) < NLOCKREG)
+      locks[i] = lk;
+  }
 }
 
 // Acquire the lock.
@@ -24,22 +56,38 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket, t0;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // The fetch-and-add is atomic, and is a full barrier.
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+  if(lk->owner != ticket){
+    t0 = rdtsc();
+    while(lk->owner != ticket){
+      // The holder may be waiting for this CPU to flush its TLB.
+      if(mycpu()->tlbflush)
+        tlbpoll();
+      pause();
+    }
+    lk->ncontend++;
+    lk->spincycles += rdtsc() - t0;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
   // references happen after the lock is acquired.
   __sync_synchronize();
 
+  lk->nacquire++;
+
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
+#ifdef LOCKDEBUG
   getcallerpcs(&lk, lk->pcs);
+#endif
 }
 
 // Release the lock.
@@ -49,7 +97,9 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+#ifdef LOCKDEBUG
   lk->pcs[0] = 0;
+#endif
   lk->cpu = 0;
 
   // Tell the C compiler and the processor to not move loads or stores
@@ -59,10 +109,9 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Serve the next ticket. Only the holder writes owner,
+  // so a plain increment is enough.
+  lk->owner++;
 
   popcli();
 }
@@ -89,7 +138,39 @@ getcallerpcs(void *v, uint pcs[])
 int
 holding(struct spinlock *lock)
 {
-  return lock->locked && lock->cpu == mycpu();
+  return lock->owner != lock->next && lock->cpu == mycpu();
+}
+
+// Fill in *ls for the nth distinct name among the registered
+// locks, adding up the locks that share it. Returns 0, or -1
+// if there are not that many names.
+int
+lockstat(int n, struct lockstat *ls)
+{
+  struct spinlock *lk;
+  uint i, j, nreg;
+
+  nreg = nlocks < NLOCKREG ? nlocks : NLOCKREG;
+  for(i = 0; i < nreg; i++){
+    for(j = 0; j < i; j++)
+      if(strncmp(locks[j]->name, locks[i]->name, sizeof(ls->name)) == 0)
+        break;
+    if(j < i || n-- > 0)
+      continue;
+    memset(ls, 0, sizeof(*ls));
+    safestrcpy(ls->name, locks[i]->name, sizeof(ls->name));
+    for(j = i; j < nreg; j++){
+      lk = locks[j];
+      if(strncmp(lk->name, ls->name, sizeof(ls->name)) != 0)
+        continue;
+      ls->nlock++;
+      ls->nacquire += lk->nacquire;
+      ls->ncontend += lk->ncontend;
+      ls->spincycles += lk->spincycles;
+    }
+    return 0;
+  }
+  return -1;
 }
 
 
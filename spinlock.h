@@ -1,11 +1,20 @@
-// Mutual exclusion lock.
+// Mutual exclusion lock: a ticket lock, so that waiters
+// get the lock in the order they asked for it.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  volatile uint next;    // Next ticket to hand out
+  volatile uint owner;   // Ticket being served; held if != next
+
+  // Statistics, updated by the holder (see lockstat()):
+  uint nacquire;         // Acquisitions
+  uint ncontend;         // Acquisitions that had to wait
+  uint64 spincycles;     // TSC cycles spent waiting
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+#ifdef LOCKDEBUG
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+#endif
 };
 
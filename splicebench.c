@@ -0,0 +1,141 @@
+// Splice benchmark. Sends a FILESIZE file into a pipe NPASS times,
+// once with read() and write() through a user buffer, as cat did,
+// and once with splice(), while a child drains the pipe. Then
+// copies the file to another file both ways. Reports the rates.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+#define FILESIZE (1024*1024)
+#define NPASS    8
+#define BUFSIZE  4096
+
+char *path = "splicebench.tmp";
+char *copypath = "splicebench.out";
+char buf[BUFSIZE];
+
+void
+fail(char *what)
+{
+  printf(1, "splicebench: %s failed\n", what);
+  exit();
+}
+
+void
+mkfile(void)
+{
+  int fd, i;
+
+  if((fd = open(path, O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  for(i = 0; i < BUFSIZE; i++)
+    buf[i] = 'a' + i%26;
+  for(i = 0; i < FILESIZE; i += BUFSIZE)
+    if(write(fd, buf, BUFSIZE) != BUFSIZE)
+      fail("write");
+  close(fd);
+}
+
+// Send the file from fd to out, with splice() if usesplice is set.
+void
+send(int fd, int out, int usesplice)
+{
+  int n;
+
+  if(usesplice){
+    while((n = splice(fd, out, 65536)) > 0)
+      ;
+  } else {
+    while((n = read(fd, buf, BUFSIZE)) > 0)
+      if(write(out, buf, n) != n)
+        fail("write");
+  }
+  if(n < 0)
+    fail(usesplice ? "splice" : "read");
+}
+
+int
+kbrate(int bytes, uint64 *t0)
+{
+  uint64 t1;
+  uint ms;
+
+  nsuptime(&t1);
+  ms = (uint)(t1 - *t0) / 1000000;
+  if(ms == 0)
+    ms = 1;
+  return bytes / 1024 * 1000 / ms;
+}
+
+int
+topipe(int usesplice)
+{
+  int p[2], fd, i, n, got;
+  uint64 t0;
+
+  if(pipe(p) < 0)
+    fail("pipe");
+  nsuptime(&t0);
+  if(fork() == 0){
+    close(p[0]);
+    for(i = 0; i < NPASS; i++){
+      if((fd = open(path, O_RDONLY)) < 0)
+        fail("open");
+      send(fd, p[1], usesplice);
+      close(fd);
+    }
+    exit();
+  }
+  close(p[1]);
+  got = 0;
+  while((n = read(p[0], buf, BUFSIZE)) > 0)
+    got += n;
+  close(p[0]);
+  wait();
+  if(got != NPASS * FILESIZE)
+    fail("pipe length");
+  return kbrate(got, &t0);
+}
+
+int
+tofile(int usesplice)
+{
+  int fd, out;
+  struct stat st;
+  uint64 t0;
+
+  nsuptime(&t0);
+  if((fd = open(path, O_RDONLY)) < 0 ||
+     (out = open(copypath, O_CREATE|O_RDWR)) < 0)
+    fail("open");
+  send(fd, out, usesplice);
+  if(fstat(out, &st) < 0 || st.size != FILESIZE)
+    fail("copy length");
+  close(fd);
+  close(out);
+  unlink(copypath);
+  return kbrate(FILESIZE, &t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rw, sp;
+
+  mkfile();
+  printf(1, "splicebench: %d CPUs, %d KB file\n", kstat(KS_NCPU),
+         FILESIZE / 1024);
+  rw = topipe(0);
+  sp = topipe(1);
+  printf(1, "splicebench: file to pipe: read/write %d KB/s, "
+         "splice %d KB/s\n", rw, sp);
+  rw = tofile(0);
+  sp = tofile(1);
+  printf(1, "splicebench: file to file: read/write %d KB/s, "
+         "splice %d KB/s\n", rw, sp);
+  unlink(path);
+  exit();
+}
@@ -0,0 +1,71 @@
+// Buffered output benchmark. Prints lines like find's, first into a
+// file and then to the console, three ways: through an unbuffered
+// stream (a write() per character, as printf() used to), with
+// printf() (a write() per line), and through a buffered stream
+// (a write() per buffer into the file, per line to the console).
+// Reports lines per second and system calls per line for each.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+#define FILELINES 2000
+#define CONSLINES 100
+
+char *path = "stdiobench.tmp";
+
+void
+run(char *what, int fd, int nline, int mode)
+{
+  struct stream *s;
+  uint64 t0, t1;
+  int i, nsys;
+  uint ms;
+
+  s = 0;
+  if(mode >= 0 && (s = fdopen(fd, mode)) == 0){
+    printf(2, "stdiobench: fdopen failed\n");
+    exit();
+  }
+  nsys = kstat(KS_SYSCALL);
+  nsuptime(&t0);
+  for(i = 0; i < nline; i++){
+    if(s)
+      fprintf(s, "./usr/src/stdiobench/%d/file%d\n", i / 100, i);
+    else
+      printf(fd, "./usr/src/stdiobench/%d/file%d\n", i / 100, i);
+  }
+  if(s)
+    fclose(s);
+  nsuptime(&t1);
+  nsys = kstat(KS_SYSCALL) - nsys;
+  ms = (uint)(t1 - t0) / 1000000;
+  if(ms == 0)
+    ms = 1;
+  printf(2, "stdiobench: %s: %d lines/s, %d.%d%d system calls per line\n",
+         what, nline * 1000 / ms, nsys / nline,
+         nsys * 10 / nline % 10, nsys * 100 / nline % 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd;
+
+  if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+    printf(2, "stdiobench: cannot create %s\n", path);
+    exit();
+  }
+  run("file, unbuffered", fd, FILELINES, _IONBF);
+  run("file, printf", fd, FILELINES, -1);
+  run("file, fully buffered", fd, FILELINES, _IOFBF);
+  close(fd);
+  unlink(path);
+
+  run("console, unbuffered", 1, CONSLINES, _IONBF);
+  run("console, printf", 1, CONSLINES, -1);
+  run("console, line buffered", 1, CONSLINES, _IOLBF);
+  exit();
+}
@@ -0,0 +1,93 @@
+// Parallel sum benchmark. 1, 2, 4 and 8 threads of one process
+// sum an array of NINT ints in its shared heap, each a slice of it,
+// NPASS times over, and add their sums into a total under a mutex.
+// Reports the time taken and the speedup over a single thread.
+// Boot with CPUS=8 to see the threads run in parallel.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+#define NINT     (1024*1024)
+#define NPASS    20
+#define MAXTHREAD 8
+#define STACKSIZE 4096
+
+int *a;
+int nthread;
+uint total;
+struct mutex lock;
+char stacks[MAXTHREAD][STACKSIZE];
+
+void
+worker(void *arg)
+{
+  int i, lo, hi, pass;
+  uint sum;
+
+  lo = (int)arg * (NINT / nthread);
+  hi = lo + NINT / nthread;
+  sum = 0;
+  for(pass = 0; pass < NPASS; pass++)
+    for(i = lo; i < hi; i++)
+      sum += a[i];
+  mutex_lock(&lock);
+  total += sum;
+  mutex_unlock(&lock);
+}
+
+int
+run(int n)
+{
+  int i, t0, tid[MAXTHREAD];
+
+  nthread = n;
+  total = 0;
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    tid[i] = thread_create(worker, (void*)i, stacks[i], STACKSIZE);
+    if(tid[i] < 0){
+      printf(1, "sumbench: thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < n; i++)
+    if(thread_join(tid[i]) != tid[i]){
+      printf(1, "sumbench: thread_join failed\n");
+      exit();
+    }
+  if(total != (uint)NPASS * NINT){
+    printf(1, "sumbench: %d threads: wrong total %d\n", n, total);
+    exit();
+  }
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, t, base;
+
+  if((a = (int*)sbrk(NINT * sizeof(int))) == (int*)-1){
+    printf(1, "sumbench: sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < NINT; i++)
+    a[i] = 1;
+  mutex_init(&lock);
+
+  printf(1, "sumbench: %d CPUs, %d ints, %d passes\n", kstat(KS_NCPU),
+         NINT, NPASS);
+  base = 0;
+  for(n = 1; n <= MAXTHREAD; n *= 2){
+    t = run(n);
+    if(t == 0)
+      t = 1;
+    if(n == 1)
+      base = t;
+    printf(1, "sumbench: %d threads: %d ms, speedup %d.%d%d\n",
+           n, t * 10, base / t, base * 10 / t % 10, base * 100 / t % 10);
+  }
+  exit();
+}
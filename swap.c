@@ -0,0 +1,202 @@
+// Swapping.
+//
+// When kalloc() runs dry, kallocuser() makes room for user memory
+// by first dropping page cache pages nobody maps, then writing user
+// pages out to the swap area: SWAPSIZE blocks after the file system,
+// laid out by mkfs (sb.swapstart, sb.nswap). A swapped-out page's
+// PTE loses PTE_P, gets PTE_SWAP, and holds the number of its swap
+// slot where the physical address was; its other flag bits stay.
+// Touching the page faults, and pagefault() calls swapin().
+//
+// Victims are chosen by swapvictim() in proc.c, which runs a clock
+// over the address spaces of processes that are not in a system
+// call. A page with PTE_A set has the bit cleared and gets a second
+// chance. Only private pages are swapped: program text shared
+// through the page cache, mapped files and 4MB pages stay put.
+//
+// Slots are reference counted, so that fork() can share a
+// swapped-out page between parent and child.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "kstat.h"
+
+#define NSLOT (SWAPSIZE / (PGSIZE/BSIZE))
+
+struct {
+  struct spinlock lock;
+  uint dev;
+  uint start;             // first block of the swap area
+  uint nslot;             // 0 until swapinit()
+  uint hint;              // where to look for a free slot
+  ushort ref[NSLOT];      // PTEs that refer to each slot
+  uchar busy[NSLOT];      // slot is being written
+  struct buf buf;         // for swap I/O, which bypasses bcache
+} swap;
+
+void
+swapinit(int dev)
+{
+  struct superblock sb;
+
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swap.buf.lock, "swapbuf");
+  readsb(dev, &sb);
+  swap.dev = dev;
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap / (PGSIZE/BSIZE);
+  if(swap.nslot > NSLOT)
+    swap.nslot = NSLOT;
+  kstats[KS_SWAPFREE] = swap.nslot;
+  cprintf("swap: %d pages at block %d\n", swap.nslot, swap.start);
+}
+
+// Read (write == 0) or write the page at mem from or to slot.
+static void
+swaprw(char *mem, uint slot, int write)
+{
+  struct buf *b = &swap.buf;
+  int i;
+
+  acquiresleep(&b->lock);
+  for(i = 0; i < PGSIZE/BSIZE; i++){
+    b->dev = swap.dev;
+    b->blockno = swap.start + slot*(PGSIZE/BSIZE) + i;
+    if(write){
+      memmove(b->data, mem + i*BSIZE, BSIZE);
+      b->flags = B_DIRTY;
+    } else {
+      b->flags = 0;
+    }
+    iderw(b);
+    if(!write)
+      memmove(mem + i*BSIZE, b->data, BSIZE);
+  }
+  releasesleep(&b->lock);
+}
+
+// Allocate a free slot, marked busy until its page is written.
+// Returns the slot, or -1 if swap is full.
+static int
+slotalloc(void)
+{
+  uint i, s;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    s = (swap.hint + i) % swap.nslot;
+    if(swap.ref[s] == 0 && !swap.busy[s]){
+      swap.ref[s] = 1;
+      swap.busy[s] = 1;
+      swap.hint = s + 1;
+      kstats[KS_SWAPFREE]--;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Drop a reference to slot; the last one frees it.
+void
+swapfree(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || swap.ref[slot] == 0)
+    panic("swapfree");
+  if(--swap.ref[slot] == 0)
+    kstats[KS_SWAPFREE]++;
+  release(&swap.lock);
+}
+
+// Add a reference to slot, for a PTE copied by fork().
+void
+swapdup(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || swap.ref[slot] == 0)
+    panic("swapdup");
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// Write one user page out to swap and free it.
+// Returns 0 on success, -1 if there is no page to take
+// or no room in swap.
+static int
+swapout(void)
+{
+  char *mem;
+  int slot;
+
+  if((slot = slotalloc()) < 0)
+    return -1;
+  if((mem = swapvictim(slot)) == 0){
+    acquire(&swap.lock);
+    swap.busy[slot] = 0;
+    release(&swap.lock);
+    swapfree(slot);
+    return -1;
+  }
+  swaprw(mem, slot, 1);
+  acquire(&swap.lock);
+  swap.busy[slot] = 0;
+  wakeup(&swap.busy[slot]);
+  release(&swap.lock);
+  kfree(mem);
+  kstatinc(KS_PAGEOUT);
+  return 0;
+}
+
+// Allocate a page of user memory, making room by swapping if
+// physical memory has run out. Returns 0 if that fails too.
+// Can sleep, so the caller must not hold a spinlock.
+char*
+kallocuser(void)
+{
+  char *mem;
+
+  while((mem = kalloc()) == 0){
+    if(pcache_reclaim() < 0 && swapout() < 0)
+      return 0;
+  }
+  return mem;
+}
+
+// Bring back the page of the current process whose PTE pte
+// says it is swapped out. Returns 0 on success, -1 if out
+// of memory.
+int
+swapin(pte_t *pte)
+{
+  uint t0, slot;
+  char *mem;
+
+  t0 = rdtsc();
+  if((mem = kallocuser()) == 0)
+    return -1;
+  slot = PTE_ADDR(*pte) >> PGSHIFT;
+  acquire(&swap.lock);
+  while(swap.busy[slot])
+    sleep(&swap.busy[slot], &swap.lock);
+  release(&swap.lock);
+  swaprw(mem, slot, 0);
+
+  // Mark it accessed, so that the clock does not
+  // pick it again straight away.
+  *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_SWAP) | PTE_P | PTE_A;
+  swapfree(slot);
+  kstatinc(KS_PAGEIN);
+  __sync_fetch_and_add(&kstats[KS_PAGEINKCYC], (rdtsc() - t0) >> 10);
+  return 0;
+}
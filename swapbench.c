@@ -0,0 +1,84 @@
+// Swap benchmark: grow the heap 8MB past the free physical memory,
+// so that part of it must live in swap, then sweep all of it twice
+// and loop over a working set that fits in memory. Reports the
+// page-ins and page-outs of each phase and the average cost of a
+// page-in fault.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+#define EXTRA   2048   // pages beyond free memory
+#define NLOOP   4
+
+int in0, out0, cyc0, t0;
+
+void
+start(void)
+{
+  in0 = kstat(KS_PAGEIN);
+  out0 = kstat(KS_PAGEOUT);
+  cyc0 = kstat(KS_PAGEINKCYC);
+  t0 = uptime();
+}
+
+void
+report(char *what)
+{
+  int in, out, kcyc;
+
+  in = kstat(KS_PAGEIN) - in0;
+  out = kstat(KS_PAGEOUT) - out0;
+  kcyc = kstat(KS_PAGEINKCYC) - cyc0;
+  printf(1, "swapbench: %s: %d ticks, %d page-ins, %d page-outs",
+         what, uptime() - t0, in, out);
+  if(in > 0)
+    printf(1, ", %d kcycles per page-in", kcyc / in);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n, ws, bad;
+  char *a;
+
+  n = kstat(KS_FREEPAGES) + EXTRA;
+  if(n - EXTRA > kstat(KS_SWAPFREE))
+    n = kstat(KS_SWAPFREE);   // keep within what swap can hold
+  printf(1, "swapbench: %d free pages, %d swap slots, using %d pages\n",
+         kstat(KS_FREEPAGES), kstat(KS_SWAPFREE), n);
+
+  start();
+  if((a = sbrk(n*4096)) == (char*)-1){
+    printf(1, "swapbench: sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i++)
+    *(int*)(a + i*4096) = i;
+  report("fill");
+
+  bad = 0;
+  for(j = 0; j < 2; j++){
+    start();
+    for(i = 0; i < n; i++)
+      if(*(int*)(a + i*4096) != i)
+        bad++;
+    report(j == 0 ? "sweep 1" : "sweep 2");
+  }
+
+  // Half of the pages that were free at the start.
+  ws = (n - EXTRA) / 2;
+  for(j = 0; j < NLOOP; j++){
+    start();
+    for(i = 0; i < ws; i++)
+      if(*(int*)(a + i*4096) != i)
+        bad++;
+    report("working set");
+  }
+
+  if(bad)
+    printf(1, "swapbench: %d pages came back wrong\n", bad);
+  exit();
+}
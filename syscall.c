@@ -14,12 +14,13 @@
 // to a saved program counter, and then the first argument.
 
 // Fetch the int at addr from the current process.
+// The memory belongs to the leader of its threads.
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
+  struct proc *curproc = myproc()->group;
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if((addr >= curproc->sz || addr+4 > curproc->sz) && mmapcheck(addr, 4) < 0)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -32,12 +33,16 @@ int
 fetchstr(uint addr, char **pp)
 {
   char *s, *ep;
-  struct proc *curproc = myproc();
+  struct proc *curproc = myproc()->group;
+  struct vma *v;
 
-  if(addr >= curproc->sz)
+  if(addr < curproc->sz)
+    ep = (char*)curproc->sz;
+  else if((v = mmapfind(curproc, addr)) != 0)
+    ep = (char*)v->end;   // pages fault in as the loop reads them
+  else
     return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
     if(*s == 0)
       return s - *pp;
@@ -52,18 +57,60 @@ argint(int n, int *ip)
   return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
 }
 
+// Check that the size bytes at addr lie within the process
+// address space. Mapped file pages and swapped-out pages are
+// faulted in here, so the system call can use them under locks.
+int
+checkptr(uint addr, int size)
+{
+  struct proc *curproc = myproc()->group;
+
+  if(size < 0)
+    return -1;
+  if((addr >= curproc->sz || addr+size > curproc->sz) &&
+     mmapcheck(addr, size) < 0)
+    return -1;
+  if(uvmprefault(addr, size) < 0)
+    return -1;
+  return 0;
+}
+
 // Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// to a block of memory of size bytes (see checkptr).
 int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
 
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(checkptr(i, size) < 0)
+    return -1;
+  *pp = (char*)i;
+  return 0;
+}
+
+// Like checkptr(), for a buffer the system call stores into:
+// it must also be writable, so that a read-only mapping makes
+// the call fail rather than fault in the kernel.
+int
+checkwptr(uint addr, int size)
+{
+  if(checkptr(addr, size) < 0)
+    return -1;
+  return uvmwritable(addr, size);
+}
+
+// Like argptr(), for a buffer the system call stores into
+// (see checkwptr).
+int
+argwptr(int n, char **pp, int size)
+{
+  int i;
+
+  if(argint(n, &i) < 0)
+    return -1;
+  if(checkwptr(i, size) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -71,8 +118,11 @@ argptr(int n, char **pp, int size)
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (Another thread or a shared mapping can change the string after
+// this check, but not make the kernel read past its end: the kernel
+// copies at most MAXPATH bytes or MAXARG strings. Another thread
+// can also unmap the string's pages; the kernel then reads zeroes
+// and the process is killed, see uvmscratch() in vm.c.)
 int
 argstr(int n, char **pp)
 {
@@ -110,6 +160,26 @@ extern int sys_readlink (void);
 extern int sys_ftag(void);
 extern int sys_funtag(void);
 extern int sys_gettag(void);
+extern int sys_kstat(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_hugeheap(void);
+extern int sys_setsched(void);
+extern int sys_nice(void);
+extern int sys_setpriority(void);
+extern int sys_nanosleep(void);
+extern int sys_nsuptime(void);
+extern int sys_lockstat(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_splice(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_writeback(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -140,6 +210,26 @@ static int (*syscalls[])(void) = {
 [SYS_ftag]    sys_ftag,
 [SYS_funtag]  sys_funtag,
 [SYS_gettag]  sys_gettag,
+[SYS_kstat]   sys_kstat,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_hugeheap] sys_hugeheap,
+[SYS_setsched] sys_setsched,
+[SYS_nice]    sys_nice,
+[SYS_setpriority] sys_setpriority,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_nsuptime] sys_nsuptime,
+[SYS_lockstat] sys_lockstat,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_splice]  sys_splice,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_writeback] sys_writeback,
 };
 
 void
@@ -149,8 +239,13 @@ syscall(void)
   struct proc *curproc = myproc();
 
   num = curproc->tf->eax;
+  pushcli();
+  mycpu()->nsyscall++;
+  popcli();
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     curproc->tf->eax = syscalls[num]();
+    if(curproc->fdhold[0])
+      fdrelease();
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             curproc->pid, curproc->name, num);
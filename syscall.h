@@ -27,3 +27,23 @@
 #define SYS_ftag 24
 #define SYS_funtag 25
 #define SYS_gettag 26
+#define SYS_kstat 27
+#define SYS_mmap 28
+#define SYS_munmap 29
+#define SYS_hugeheap 30
+#define SYS_setsched 31
+#define SYS_nice 32
+#define SYS_setpriority 33
+#define SYS_nanosleep 34
+#define SYS_nsuptime 35
+#define SYS_lockstat 36
+#define SYS_clone 37
+#define SYS_join 38
+#define SYS_futex_wait 39
+#define SYS_futex_wake 40
+#define SYS_splice 41
+#define SYS_readv  42
+#define SYS_writev 43
+#define SYS_pread  44
+#define SYS_pwrite 45
+#define SYS_writeback 46
@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -26,7 +27,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -35,23 +36,6 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
-// Takes over file reference from caller on success.
-static int
-fdalloc(struct file *f)
-{
-  int fd;
-  struct proc *curproc = myproc();
-
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
-      return fd;
-    }
-  }
-  return -1;
-}
-
 int
 sys_dup(void)
 {
@@ -73,7 +57,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argwptr(1, &p, n) < 0)
     return -1;
   return fileread(f, p, n);
 }
@@ -90,15 +74,120 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Fetch the vector of cnt buffers that argument 1 points to into
+// iov, checking each buffer the way argptr() does, or argwptr()
+// if the system call stores into them.
+static int
+argiov(struct iovec *iov, int *pcnt, int store)
+{
+  struct iovec *uiov;
+  int i, cnt;
+
+  if(argint(2, &cnt) < 0 || cnt < 0 || cnt > IOV_MAX)
+    return -1;
+  if(argptr(1, (char**)&uiov, cnt*sizeof(*uiov)) < 0)
+    return -1;
+  // Copy first: the process could change the vector once checked.
+  memmove(iov, uiov, cnt*sizeof(*uiov));
+  for(i = 0; i < cnt; i++){
+    if(store ? checkwptr((uint)iov[i].base, iov[i].len) < 0 :
+       checkptr((uint)iov[i].base, iov[i].len) < 0)
+      return -1;
+  }
+  *pcnt = cnt;
+  return 0;
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(iov, &cnt, 1) < 0)
+    return -1;
+  return filereadv(f, iov, cnt, -1);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(iov, &cnt, 0) < 0)
+    return -1;
+  return filewritev(f, iov, cnt, -1);
+}
+
+// Read at offset off, leaving the file's offset alone.
+int
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int off;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &iov.len) < 0 ||
+     argwptr(1, (char**)&iov.base, iov.len) < 0 || argint(3, &off) < 0)
+    return -1;
+  if(off < 0)
+    return -1;
+  return filereadv(f, &iov, 1, off);
+}
+
+// Write at offset off, leaving the file's offset alone.
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int off;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &iov.len) < 0 ||
+     argptr(1, (char**)&iov.base, iov.len) < 0 || argint(3, &off) < 0)
+    return -1;
+  if(off < 0)
+    return -1;
+  return filewritev(f, &iov, 1, off);
+}
+
+// Turn the log's writeback daemon on or off (see log.c).
+int
+sys_writeback(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return logwriteback(on);
+}
+
+// Move up to n bytes from one open file to another, which may be
+// a pipe, without copying them through user memory.
+int
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(n < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
 int
 sys_close(void)
 {
   int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  if(argint(0, &fd) < 0 || (f = fdremove(fd)) == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
@@ -109,11 +198,44 @@ sys_fstat(void)
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argwptr(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
   return filestat(f, st);
 }
 
+// The address argument is only a hint, and is ignored.
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int len, prot, flags, off, r;
+
+  if(argint(1, &len) < 0 || argint(2, &prot) < 0 || argint(3, &flags) < 0 ||
+     argfd(4, 0, &f) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(len <= 0 || off < 0)
+    return -1;
+  mmlock();
+  r = mmap(f, len, prot, flags, off);
+  mmunlock();
+  return r;
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len, r;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  if(len <= 0)
+    return -1;
+  mmlock();
+  r = munmap(addr, len);
+  mmunlock();
+  return r;
+}
+
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
@@ -258,7 +380,7 @@ create(char *path, short type, short major, short minor)
     return 0;
   }
 
-  if((ip = ialloc(dp->dev, type)) == 0)
+  if((ip = ialloc(dp->dev, type, dp)) == 0)
     panic("create: ialloc");
 
   ilock(ip);
@@ -303,6 +425,7 @@ sys_open(void)
       end_op();
       return -1;
     }
+    iunlock(ip);
   }
   else {
     int result = read_link_to_buf(path, sym_path, FILENAMESIZE);
@@ -326,29 +449,32 @@ sys_open(void)
           return -1;
       }
     }
-    ilock(ip);
+    ilock_shared(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
-      iunlockput(ip);
+      iunlockput_shared(ip);
       end_op();
       return -1;
     }
+    iunlock_shared(ip);
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
-    iunlockput(ip);
+  if((f = filealloc()) == 0){
+    iput(ip);
     end_op();
     return -1;
   }
-  iunlock(ip);
   end_op();
 
+  // Fill f in before another thread can find it by its fd.
   f->type = FD_INODE;
   f->ip = ip;
   f->off = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -417,16 +543,15 @@ sys_chdir(void)
     }
   }
 
-  ilock(ip);
+  ilock_shared(ip);
   if(ip->type != T_DIR){
     // Not a directory.
     if (DEBUG > 1) cprintf("CHDIR: ip->type not T_DIR, is %d\n", ip->type);
-    iunlockput(ip);
+    iunlockput_shared(ip);
     return -1;
   }
-  iunlock(ip);
-  iput(myproc()->cwd);
-  myproc()->cwd = ip;
+  iunlock_shared(ip);
+  setcwd(ip);
   return 0;
 }
 
@@ -463,14 +588,14 @@ sys_pipe(void)
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argwptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
+      fdremove(fd0);
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -530,7 +655,8 @@ sys_readlink(void)
   char *buf;
   uint bufsiz;
 
-  if(argstr(0, &path) < 0 || argstr(1, &buf) < 0  || argint(2, (int*)&bufsiz) < 0)
+  if(argstr(0, &path) < 0 || argint(2, (int*)&bufsiz) < 0 ||
+     argwptr(1, &buf, bufsiz) < 0)
     return -1;
 
   return read_link_to_buf(path, buf, bufsiz);
@@ -555,26 +681,26 @@ read_link_to_buf(char* path, char* buf, uint bufsiz)
     if (DEBUG > 1) cprintf("SYMLINK: namei is empty for %s\n", path);
     return -1;
   }
-  ilock(ip);
+  ilock_shared(ip);
 
   if (!(ip->type == T_SYMLINK)) {
     if (DEBUG > 1) cprintf("SYMLINK: %s not a symlink.\n", path);
-    iunlock(ip);
+    iunlock_shared(ip);
     return -1;
   }
 
   for (i = 0; i < MAX_DEREFERENCE ; i++) {
     if((sym_ip = namei((char*)ip->addrs)) == 0) {
       if (DEBUG > 1) cprintf("SYMLINK: could not load address %s.\n", (char*) ip->addrs);
-      iunlock(ip);
+      iunlock_shared(ip);
       return -1;
     }
       if (DEBUG > 1) cprintf("SYMLINK: loaded address %s.\n", (char*) ip->addrs);
 
     if (sym_ip->type == T_SYMLINK) {
-      iunlock(ip);
+      iunlock_shared(ip);
       ip = sym_ip;
-      ilock(ip);
+      ilock_shared(ip);
     }
     else {
       break;
@@ -584,18 +710,18 @@ read_link_to_buf(char* path, char* buf, uint bufsiz)
   if (i == MAX_DEREFERENCE) {
     panic("symbolic link exceeds MAX_DEREFERENCE ");
   }
-  ilock(sym_ip);
+  ilock_shared(sym_ip);
   if (DEBUG > 1) cprintf("SYMLINK: final sym_ip->type = %d.\n", sym_ip->type);
 
   if (sym_ip->type == T_FILE || sym_ip->type == T_DIR) {
     safestrcpy(buf, (char*)ip->addrs, bufsiz);
-    iunlock(ip);
-    iunlock(sym_ip);
+    iunlock_shared(ip);
+    iunlock_shared(sym_ip);
     if (DEBUG > 1) cprintf("SYMLINK: final result: %s.\n", buf);
     return strlen(buf);
   }
-  iunlock(ip);
-  iunlock(sym_ip);
+  iunlock_shared(ip);
+  iunlock_shared(sym_ip);
   return -1;
 }
 
@@ -637,11 +763,10 @@ int sys_gettag(void) {
     char *buf;
     struct file *file_ptr;
 
-    if(argfd(0, &fd, &file_ptr) < 0 || argstr(1, &key) < 0 || argstr(2, &buf) < 0)
+    // fs_gettag() stores a value of up to 30 bytes in buf.
+    if(argfd(0, &fd, &file_ptr) < 0 || argstr(1, &key) < 0 || argwptr(2, &buf, 30) < 0)
         return -1;
 
-    begin_op();
     ret = fs_gettag(file_ptr,key,buf);
-    end_op();
     return ret;
 }
@@ -6,6 +6,11 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "sched.h"
+#include "kstat.h"
+#include "lockstat.h"
+
+uint kstats[NKSTAT];
 
 int
 sys_fork(void)
@@ -26,6 +31,28 @@ sys_wait(void)
   return wait();
 }
 
+// Start a thread running fn(arg) on the stack that ends at stack
+// (see clone() in proc.c).
+int
+sys_clone(void)
+{
+  int fn, arg, stack;
+
+  if(argint(0, &fn) < 0 || argint(1, &arg) < 0 || argint(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
+int
+sys_join(void)
+{
+  int tid;
+
+  if(argint(0, &tid) < 0)
+    return -1;
+  return join(tid);
+}
+
 int
 sys_kill(void)
 {
@@ -50,42 +77,167 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
+  mmlock();
+  addr = myproc()->group->sz;
   if(growproc(n) < 0)
-    return -1;
+    addr = -1;
+  mmunlock();
   return addr;
 }
 
+// Turn the huge-page heap on or off for the calling process.
+// While on, sbrk() maps the 4MB-aligned parts of new memory with
+// 4MB pages. Returns the previous setting.
+int
+sys_hugeheap(void)
+{
+  int on, old;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  old = myproc()->group->hugeheap;
+  myproc()->group->hugeheap = (on != 0);
+  return old;
+}
+
 int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
+  if(n <= 0)
+    return 0;
+  return sleepuntil(nsnow() + (uint64)n * TICKNS);
+}
+
+// Sleep for sec seconds and nsec nanoseconds.
+int
+sys_nanosleep(void)
+{
+  int sec, nsec;
+
+  if(argint(0, &sec) < 0 || argint(1, &nsec) < 0)
+    return -1;
+  if(sec < 0 || nsec < 0 || nsec >= 1000000000)
+    return -1;
+  return sleepuntil(nsnow() + (uint64)sec * 1000000000 + nsec);
+}
+
+// Store the nanoseconds since boot in *t.
+int
+sys_nsuptime(void)
+{
+  uint64 *t;
+
+  if(argwptr(0, (char**)&t, sizeof(*t)) < 0)
+    return -1;
+  *t = nsnow();
   return 0;
 }
 
-// return how many clock tick interrupts have occurred
+// return how many clock ticks have passed
 // since start.
 int
 sys_uptime(void)
 {
-  uint xticks;
+  return uptime();
+}
+
+// Choose the scheduling policy (see sched.h).
+// Returns the previous one.
+int
+sys_setsched(void)
+{
+  int pol;
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  if(argint(0, &pol) < 0)
+    return -1;
+  return setsched(pol);
+}
+
+// Add inc to the nice value of the current process.
+// Returns the new nice value.
+int
+sys_nice(void)
+{
+  int inc;
+
+  if(argint(0, &inc) < 0)
+    return -1;
+  // Keep the sum from overflowing; setpriority() clamps it.
+  if(inc > NICE_MAX - NICE_MIN)
+    inc = NICE_MAX - NICE_MIN;
+  if(inc < NICE_MIN - NICE_MAX)
+    inc = NICE_MIN - NICE_MAX;
+  setpriority(myproc()->pid, myproc()->nice + inc);
+  return myproc()->nice;
+}
+
+int
+sys_setpriority(void)
+{
+  int pid, nice;
+
+  if(argint(0, &pid) < 0 || argint(1, &nice) < 0)
+    return -1;
+  return setpriority(pid, nice);
+}
+
+// Fill in the statistics of the nth spin lock name
+// (see lockstat.h).
+int
+sys_lockstat(void)
+{
+  struct lockstat *ls;
+  int n;
+
+  if(argint(0, &n) < 0 || argwptr(1, (char**)&ls, sizeof(*ls)) < 0)
+    return -1;
+  return lockstat(n, ls);
+}
+
+// Return kernel statistic n (see kstat.h).
+int
+sys_kstat(void)
+{
+  struct cpu *c;
+  int n;
+  uint sum;
+
+  if(argint(0, &n) < 0 || n < 0 || n >= NKSTAT)
+    return -1;
+  if(n == KS_SYSCALL){
+    // Counted per CPU, so that system calls do not share a line.
+    sum = 0;
+    for(c = cpus; c < &cpus[ncpu]; c++)
+      sum += c->nsyscall;
+    return sum;
+  }
+  return kstats[n];
+}
+
+// Sleep if the int at addr holds val (see futexwait() in proc.c).
+int
+sys_futex_wait(void)
+{
+  char *addr;
+  int val;
+
+  if(argptr(0, &addr, sizeof(int)) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait((uint)addr, val);
+}
+
+// Wake up to n processes sleeping on the int at addr.
+int
+sys_futex_wake(void)
+{
+  char *addr;
+  int n;
+
+  if(argptr(0, &addr, sizeof(int)) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake((uint)addr, n);
 }
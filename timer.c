@@ -0,0 +1,229 @@
+// Clock and timers.
+//
+// The clock is the time-stamp counter, converted to nanoseconds since
+// boot by nsnow(). Each CPU's LAPIC timer runs in one-shot mode, armed
+// by timerarm() for the CPU's next deadline:
+//  - the earliest wakeup in the CPU's timer heap, which holds the
+//    processes in sleepuntil() that went to sleep on this CPU,
+//    ordered by deadline, and
+//  - if the CPU is running a process, its next scheduling tick,
+//    TICKNS after the last one (see schedtick() in sched.c).
+// An idle CPU with nothing in its heap takes no timer interrupts
+// at all. Both clocks are calibrated at boot against channel 2 of
+// the 8253 PIT, whose frequency is known.
+//
+// The heaps are protected by ptable.lock; a CPU peeks at the top
+// of its own without it in interrupt handlers.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "kstat.h"
+
+#define PITHZ     1193182
+#define CALUS     10000              // calibrate over 10ms
+#define MAXARM    100000000ULL       // arm at most 100ms ahead
+#define NEVER     (~0ULL)
+
+static uint64 tsc0;                  // TSC at boot
+static uint tscperus;                // TSC cycles per microsecond
+static uint lapicperus;              // LAPIC timer counts per microsecond
+
+// n / d, for a quotient that may not fit in 32 bits.
+// (The kernel is not linked with libgcc's 64-bit division.)
+static uint64
+udiv64(uint64 n, uint d)
+{
+  uint qhi, qlo, r;
+
+  qhi = (uint)(n >> 32) / d;
+  r = (uint)(n >> 32) % d;
+  asm("divl %4" : "=a" (qlo), "=d" (r) : "a" ((uint)n), "1" (r), "rm" (d));
+  return (uint64)qhi << 32 | qlo;
+}
+
+// Measure the TSC and the LAPIC timer against CALUS
+// microseconds of PIT channel 2. Runs once, on the boot CPU.
+void
+timerinit(void)
+{
+  uint64 t0, t1;
+  uint left;
+
+  outb(0x61, inb(0x61) & ~0x03);     // gate off, speaker off
+  outb(0x43, 0xB0);                  // channel 2, mode 0, lo/hi byte
+  outb(0x42, (PITHZ/(1000000/CALUS)) & 0xFF);
+  outb(0x42, (PITHZ/(1000000/CALUS)) >> 8);
+  lapictimer(0xFFFFFFFF);
+  t0 = rdtsc64();
+  outb(0x61, inb(0x61) | 0x01);      // gate on: start counting
+  while((inb(0x61) & 0x20) == 0)     // until the output goes high
+    ;
+  t1 = rdtsc64();
+  left = lapictimercount();
+  lapictimer(0);
+
+  tsc0 = t0;
+  tscperus = (uint)(t1 - t0) / CALUS;
+  lapicperus = (0xFFFFFFFF - left) / CALUS;
+  if(tscperus == 0)
+    tscperus = 1;
+  if(lapicperus == 0)
+    lapicperus = 1;
+  cprintf("timer: %d TSC cycles/us, %d LAPIC counts/us\n",
+          tscperus, lapicperus);
+}
+
+// Nanoseconds since boot.
+uint64
+nsnow(void)
+{
+  return udiv64((rdtsc64() - tsc0) * 1000, tscperus);
+}
+
+// Timer ticks (TICKNS) since boot.
+uint
+uptime(void)
+{
+  return udiv64(nsnow(), TICKNS);
+}
+
+static void
+heapswap(struct cpu *c, int i, int j)
+{
+  struct proc *p;
+
+  p = c->timers[i];
+  c->timers[i] = c->timers[j];
+  c->timers[j] = p;
+  c->timers[i]->timeridx = i;
+  c->timers[j]->timeridx = j;
+}
+
+static void
+siftup(struct cpu *c, int i)
+{
+  while(i > 0 && c->timers[i]->wakeat < c->timers[(i-1)/2]->wakeat){
+    heapswap(c, i, (i-1)/2);
+    i = (i-1)/2;
+  }
+}
+
+static void
+siftdown(struct cpu *c, int i)
+{
+  int j;
+
+  for(;;){
+    j = 2*i + 1;
+    if(j >= c->ntimer)
+      break;
+    if(j+1 < c->ntimer && c->timers[j+1]->wakeat < c->timers[j]->wakeat)
+      j++;
+    if(c->timers[i]->wakeat <= c->timers[j]->wakeat)
+      break;
+    heapswap(c, i, j);
+    i = j;
+  }
+}
+
+// Add p, whose p->wakeat is set, to this CPU's heap.
+void
+timeradd(struct proc *p)
+{
+  struct cpu *c = mycpu();
+
+  if(p->timercpu)
+    panic("timeradd");
+  p->timercpu = c;
+  p->timeridx = c->ntimer++;
+  c->timers[p->timeridx] = p;
+  siftup(c, p->timeridx);
+}
+
+// Take p out of the heap it is in, if any.
+void
+timerdel(struct proc *p)
+{
+  struct cpu *c = p->timercpu;
+  int i = p->timeridx;
+
+  if(c == 0)
+    return;
+  p->timercpu = 0;
+  if(i != --c->ntimer){
+    c->timers[i] = c->timers[c->ntimer];
+    c->timers[i]->timeridx = i;
+    siftdown(c, i);
+    siftup(c, i);
+  }
+}
+
+// Remove and return the first process in c's heap
+// whose deadline is at or before now, or 0.
+struct proc*
+timerpop(struct cpu *c, uint64 now)
+{
+  struct proc *p;
+
+  if(c->ntimer == 0 || c->timers[0]->wakeat > now)
+    return 0;
+  p = c->timers[0];
+  timerdel(p);
+  return p;
+}
+
+// Arm this CPU's LAPIC timer for its next deadline, unless
+// it is armed for that or an earlier one already.
+void
+timerarm(void)
+{
+  struct cpu *c = mycpu();
+  uint64 when, now, d;
+  uint n;
+
+  when = NEVER;
+  if(c->ntimer > 0)
+    when = c->timers[0]->wakeat;
+  if(c->proc && c->tickat < when)
+    when = c->tickat;
+  if(when == NEVER || (c->timerat && c->timerat <= when))
+    return;
+  now = nsnow();
+  d = when > now ? when - now : 0;
+  if(d > MAXARM)
+    d = MAXARM;
+  c->timerat = now + d;
+  n = ((uint)d / 1000) * lapicperus;
+  lapictimer(n ? n : 1);
+}
+
+// Handle a LAPIC timer interrupt: wake the processes whose time
+// has come and arm the timer again.
+// Returns 1 if a scheduling tick of the running process is due.
+int
+timerintr(void)
+{
+  struct cpu *c = mycpu();
+  uint64 now;
+  int tick;
+
+  kstatinc(KS_TIMERINT);
+  now = nsnow();
+  c->timerat = 0;
+  ticks = udiv64(now, TICKNS);
+  tick = 0;
+  if(c->proc && now >= c->tickat){
+    c->tickat = now + TICKNS;
+    tick = 1;
+  }
+  if(c->ntimer > 0 && c->timers[0]->wakeat <= now)
+    timerexpire(now);
+  else
+    timerarm();
+  return tick;
+}
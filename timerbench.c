@@ -0,0 +1,46 @@
+// Timer benchmark. Counts the timer interrupts and idle wakeups
+// per second while the machine has nothing to do, then measures
+// how closely nanosleep() keeps to the time asked for, from 50us
+// to 25ms: the mean and worst oversleep of NSAMPLE sleeps each.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+#define IDLESEC 2
+#define NSAMPLE 20
+
+int durations[] = { 50000, 100000, 1000000, 5000000, 10000000, 25000000 };
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, t, i0, w0, over, sum, worst;
+  uint64 t0, t1;
+
+  i0 = kstat(KS_TIMERINT);
+  w0 = kstat(KS_IDLEWAKE);
+  nanosleep(IDLESEC, 0);
+  printf(1, "timerbench: idle, %d CPUs: %d timer interrupts/s, "
+         "%d idle wakeups/s\n", kstat(KS_NCPU),
+         (kstat(KS_TIMERINT) - i0) / IDLESEC,
+         (kstat(KS_IDLEWAKE) - w0) / IDLESEC);
+
+  for(i = 0; i < sizeof(durations)/sizeof(durations[0]); i++){
+    t = durations[i];
+    sum = worst = 0;
+    for(j = 0; j < NSAMPLE; j++){
+      nsuptime(&t0);
+      nanosleep(0, t);
+      nsuptime(&t1);
+      over = (uint)(t1 - t0) - t;
+      sum += over;
+      if(over > worst)
+        worst = over;
+    }
+    printf(1, "timerbench: nanosleep %d us: oversleep mean %d us, "
+           "worst %d us\n", t / 1000, sum / NSAMPLE / 1000, worst / 1000);
+  }
+  exit();
+}
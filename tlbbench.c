@@ -0,0 +1,62 @@
+// TLB benchmark: walk a 64MB array a page at a time, first with
+// the heap in 4KB pages and then with a huge-page heap (4MB pages,
+// see hugeheap()). Each run is in its own child process.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+#define ARRAYSIZE (64*1024*1024)
+#define NPAGES    (ARRAYSIZE/4096)
+#define HUGESIZE  (4*1024*1024)
+#define NPASS     20
+#define STRIDE    4099   // pages between touches; odd, so all are visited
+
+void
+walk(int huge)
+{
+  int i, j, t0, t1, t2, free0, huge0, nhuge;
+  uint sum;
+  char *a;
+
+  hugeheap(huge);
+  free0 = kstat(KS_FREEPAGES);
+  huge0 = kstat(KS_HUGEPAGES);
+  t0 = uptime();
+  a = sbrk(ARRAYSIZE + HUGESIZE);
+  if(a == (char*)-1){
+    printf(1, "tlbbench: sbrk failed\n");
+    exit();
+  }
+  a = (char*)(((uint)a + HUGESIZE - 1) & ~(HUGESIZE - 1));
+  t1 = uptime();
+  sum = 0;
+  for(j = 0; j < NPASS; j++){
+    for(i = 0; i < NPAGES; i++){
+      sum += a[((i * STRIDE) & (NPAGES - 1)) * 4096 + j]++;
+    }
+  }
+  t2 = uptime();
+  // 4MB pages come out of the free 4KB pages.
+  nhuge = kstat(KS_HUGEPAGES) - huge0;
+  printf(1, "tlbbench: %s pages: sbrk %d ticks, %d passes %d ticks, "
+         "%d 4KB pages %d 4MB pages (sum %d)\n",
+         huge ? "4MB" : "4KB", t1 - t0, NPASS, t2 - t1,
+         free0 - kstat(KS_FREEPAGES) - nhuge*1024, nhuge, sum);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int huge;
+
+  for(huge = 0; huge < 2; huge++){
+    if(fork() == 0){
+      walk(huge);
+      exit();
+    }
+    wait();
+  }
+  exit();
+}
@@ -11,8 +11,7 @@
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
-struct spinlock tickslock;
-uint ticks;
+uint ticks;   // updated by timer interrupts; see uptime()
 
 void
 tvinit(void)
@@ -22,8 +21,6 @@ tvinit(void)
   for(i = 0; i < 256; i++)
     SETGATE(idt[i], 0, SEG_KCODE<<3, vectors[i], 0);
   SETGATE(idt[T_SYSCALL], 1, SEG_KCODE<<3, vectors[T_SYSCALL], DPL_USER);
-
-  initlock(&tickslock, "time");
 }
 
 void
@@ -36,6 +33,8 @@ idtinit(void)
 void
 trap(struct trapframe *tf)
 {
+  int tick = 0;
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
@@ -48,12 +47,15 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    tick = timerintr();
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_WAKE:
+    // Another CPU has work for us; see runqkick().
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_TLB:
+    tlbpoll();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -78,6 +80,22 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    if(myproc() != 0 && pagefault(rcr2(), tf->err) == 0)
+      break;
+    if(myproc() != 0 && (tf->cs&3) == 0 && rcr2() < KERNBASE &&
+       uvmscratch(rcr2()) == 0){
+      // A system call used user memory that another thread had
+      // unmapped, or wrote to a read-only page; let the call
+      // finish, and kill the process on its way out.
+      cprintf("pid %d %s: bad user address 0x%x in system call "
+              "--kill proc\n", myproc()->pid, myproc()->name, rcr2());
+      myproc()->killed = 1;
+      myproc()->group->killed = 1;
+      break;
+    }
+    // Not a fault we can fix up; treat it like any other trap.
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -100,11 +118,16 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU on clock tick, once its
+  // quantum is up (see schedtick() in sched.c).
   // If interrupts were on while locks held, would need to check nlock.
-  if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+  if(myproc() && myproc()->state == RUNNING && tick &&
+     schedtick(myproc())){
+    // Preempted in user space: its pages may be swapped out
+    // while it waits (see swapvictim()).
+    myproc()->inuser = (tf->cs&3) == DPL_USER;
     yield();
+  }
 
   // Check if the process has been killed since we yielded
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
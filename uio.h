@@ -0,0 +1,9 @@
+// Buffer vectors for readv() and writev().
+// Both the kernel and user programs use this header file.
+
+#define IOV_MAX 16   // most buffers in one readv() or writev()
+
+struct iovec {
+  void *base;
+  int len;
+};
@@ -0,0 +1,166 @@
+// Vectored I/O benchmark. Writes NREC records of three pieces
+// (header, body, trailer) to a file, first with a write() per
+// piece and then with one writev() per record, and reads them back
+// with one read() per piece and one readv() per record. Then
+// NREADER processes share one descriptor and pread() records at
+// their own offsets, checking what they get. Reports the time and
+// the system calls made (kstat KS_SYSCALL) for each.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+#include "uio.h"
+
+#define NREC     2000
+#define NREADER  4
+#define HDRSIZE  8
+#define BODYSIZE 48
+#define TRLSIZE  8
+#define RECSIZE  (HDRSIZE+BODYSIZE+TRLSIZE)
+
+char *path = "uiobench.tmp";
+char hdr[HDRSIZE], body[BODYSIZE], trl[TRLSIZE];
+
+int nsys0;
+uint64 t0;
+
+void
+fail(char *what)
+{
+  printf(1, "uiobench: %s failed\n", what);
+  exit();
+}
+
+void
+start(void)
+{
+  nsuptime(&t0);
+  nsys0 = kstat(KS_SYSCALL);
+}
+
+void
+report(char *what)
+{
+  uint64 t1;
+  int nsys;
+
+  nsuptime(&t1);
+  nsys = kstat(KS_SYSCALL) - nsys0;
+  printf(1, "uiobench: %s: %d us, %d system calls\n", what,
+         (uint)(t1 - t0) / 1000, nsys);
+}
+
+void
+fill(int r)
+{
+  memset(hdr, 'h', HDRSIZE);
+  memset(body, 'a' + r % 26, BODYSIZE);
+  memset(trl, 't', TRLSIZE);
+  hdr[0] = r & 0xff;
+  hdr[1] = (r >> 8) & 0xff;
+}
+
+void
+setiov(struct iovec *iov)
+{
+  iov[0].base = hdr;  iov[0].len = HDRSIZE;
+  iov[1].base = body; iov[1].len = BODYSIZE;
+  iov[2].base = trl;  iov[2].len = TRLSIZE;
+}
+
+void
+writes(int vectored)
+{
+  struct iovec iov[3];
+  int fd, r;
+
+  unlink(path);
+  if((fd = open(path, O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  setiov(iov);
+  start();
+  for(r = 0; r < NREC; r++){
+    fill(r);
+    if(vectored){
+      if(writev(fd, iov, 3) != RECSIZE)
+        fail("writev");
+    } else if(write(fd, hdr, HDRSIZE) != HDRSIZE ||
+              write(fd, body, BODYSIZE) != BODYSIZE ||
+              write(fd, trl, TRLSIZE) != TRLSIZE)
+      fail("write");
+  }
+  report(vectored ? "writev, 1 per record" : "write, 3 per record");
+  close(fd);
+}
+
+void
+reads(int vectored)
+{
+  struct iovec iov[3];
+  int fd, r;
+
+  if((fd = open(path, O_RDONLY)) < 0)
+    fail("open");
+  setiov(iov);
+  start();
+  for(r = 0; r < NREC; r++){
+    if(vectored){
+      if(readv(fd, iov, 3) != RECSIZE)
+        fail("readv");
+    } else if(read(fd, hdr, HDRSIZE) != HDRSIZE ||
+              read(fd, body, BODYSIZE) != BODYSIZE ||
+              read(fd, trl, TRLSIZE) != TRLSIZE)
+      fail("read");
+    if((hdr[0] & 0xff) != (r & 0xff) || body[0] != 'a' + r % 26)
+      fail("record check");
+  }
+  report(vectored ? "readv, 1 per record" : "read, 3 per record");
+  close(fd);
+}
+
+// NREADER processes pread() every record through one shared
+// descriptor; with read() they would race for its offset.
+void
+preads(void)
+{
+  char rec[RECSIZE];
+  int fd, i, r, bad;
+
+  if((fd = open(path, O_RDONLY)) < 0)
+    fail("open");
+  start();
+  for(i = 0; i < NREADER; i++){
+    if(fork() == 0){
+      bad = 0;
+      for(r = i; r < NREC; r += NREADER){
+        if(pread(fd, rec, RECSIZE, r * RECSIZE) != RECSIZE ||
+           (rec[0] & 0xff) != (r & 0xff) ||
+           rec[HDRSIZE] != 'a' + r % 26)
+          bad++;
+      }
+      if(bad)
+        printf(1, "uiobench: reader %d: %d bad records\n", i, bad);
+      exit();
+    }
+  }
+  for(i = 0; i < NREADER; i++)
+    wait();
+  report("pread, 4 readers sharing a descriptor");
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf(1, "uiobench: %d records of %d bytes in 3 pieces\n",
+         NREC, RECSIZE);
+  writes(0);
+  writes(1);
+  reads(0);
+  reads(1);
+  preads();
+  unlink(path);
+  exit();
+}
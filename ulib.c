@@ -4,6 +4,17 @@
 #include "user.h"
 #include "x86.h"
 
+// Set by printf.c when there are streams to flush.
+void (*exitflush)(void);
+
+int
+exit(void)
+{
+  if(exitflush)
+    exitflush();
+  _exit();
+}
+
 char*
 strcpy(char *s, char *t)
 {
@@ -103,3 +114,119 @@ memmove(void *vdst, void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Threads. thread_create() starts fn(arg) in a new thread of this
+// process, on the size bytes of stack at stack; the thread exits
+// when fn returns. Returns the thread's id, for thread_join().
+
+struct thread_start {
+  void (*fn)(void*);
+  void *arg;
+};
+
+static void
+thread_start(void *a)
+{
+  struct thread_start *ts = a;
+
+  ts->fn(ts->arg);
+  exit();
+}
+
+int
+thread_create(void (*fn)(void*), void *arg, void *stack, uint size)
+{
+  struct thread_start *ts;
+
+  ts = (struct thread_start*)(((uint)stack + size) & ~15) - 1;
+  ts->fn = fn;
+  ts->arg = arg;
+  return clone(thread_start, ts, ts);
+}
+
+int
+thread_join(int tid)
+{
+  return join(tid);
+}
+
+// Mutexes, after Drepper's "Futexes Are Tricky": a free mutex
+// is taken with one compare-and-swap and released with one
+// exchange, and only a mutex with waiters costs system calls.
+// Futexes are named by physical address, so a mutex in a
+// MAP_SHARED mapping works between processes too.
+
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  uint c;
+
+  if((c = cmpxchg(&m->state, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = xchg(&m->state, 2);
+  while(c != 0){
+    futex_wait((volatile int*)&m->state, 2);
+    c = xchg(&m->state, 2);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(xchg(&m->state, 0) == 2)
+    futex_wake((volatile int*)&m->state, 1);
+}
+
+// Condition variables. A waiter notes the sequence number before
+// letting go of the mutex, and sleeps only if no signal has bumped
+// it since, so no signal is lost in between.
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  uint seq;
+
+  seq = c->seq;
+  mutex_unlock(m);
+  futex_wait((volatile int*)&c->seq, seq);
+  // Take the mutex as contended: others may be waiting for it.
+  while(xchg(&m->state, 2) != 0)
+    futex_wait((volatile int*)&m->state, 2);
+}
+
+static void
+cond_bump(struct cond *c)
+{
+  uint seq;
+
+  do
+    seq = c->seq;
+  while(cmpxchg(&c->seq, seq, seq + 1) != seq);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  cond_bump(c);
+  futex_wake((volatile int*)&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  cond_bump(c);
+  futex_wake((volatile int*)&c->seq, 0x7fffffff);
+}
@@ -1,9 +1,23 @@
 struct stat;
+struct stream;
+struct iovec;
+struct lockstat;
 struct rtcdate;
 
+// A lock and a condition variable for threads, or for processes
+// that share the memory they are in (see ulib.c).
+struct mutex {
+  volatile uint state;   // 0 free, 1 held, 2 held with waiters
+};
+
+struct cond {
+  volatile uint seq;     // bumped by each signal
+};
+
 // system calls
 int fork(void);
-int exit(void) __attribute__((noreturn));
+int exit(void) __attribute__((noreturn));   // ulib.c; flushes streams
+int _exit(void) __attribute__((noreturn));
 int wait(void);
 int pipe(int*);
 int write(int, void*, int);
@@ -30,17 +44,61 @@ int readlink(char*, char*, uint);
 int ftag(int, char*, char*);
 int funtag(int, char*);
 int gettag(int, char*, char*);
+int kstat(int);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int hugeheap(int);
+int setsched(int);
+int nice(int);
+int setpriority(int, int);
+int nanosleep(int, int);
+int nsuptime(uint64*);
+int lockstat(int, struct lockstat*);
+int clone(void(*)(void*), void*, void*);
+int join(int);
+int futex_wait(volatile int*, int);
+int futex_wake(volatile int*, int);
+int splice(int, int, int);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, void*, int, int);
+int writeback(int);
 
 // ulib.c
+extern void (*exitflush)(void);
 int stat(char*, struct stat*);
 char* strcpy(char*, char*);
 void *memmove(void*, void*, int);
 char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
 void printf(int, char*, ...);
+
+// printf.c: buffered output streams
+#define _IOFBF 0   // write when the buffer is full
+#define _IOLBF 1   // ... or holds a newline
+#define _IONBF 2   // write at once
+extern struct stream *sout, *serr;   // fds 1 and 2
+struct stream* fdopen(int, int);
+int fclose(struct stream*);
+int fflush(struct stream*);
+void setvbuf(struct stream*, int);
+int fwrite(struct stream*, void*, int);
+int fputc(int, struct stream*);
+int fputs(char*, struct stream*);
+void fprintf(struct stream*, char*, ...);
 char* gets(char*, int max);
 uint strlen(char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int thread_create(void(*)(void*), void*, void*, uint);
+int thread_join(int);
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
@@ -7,6 +7,7 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "uio.h"
 
 char buf[8192];
 char name[3];
@@ -1695,6 +1696,452 @@ fsfull()
   printf(1, "fsfull test finished\n");
 }
 
+// mmap: lazy faults, MAP_SHARED writes seen by read() and
+// written back on munmap, MAP_PRIVATE writes kept private,
+// and mappings inherited across fork.
+void
+mmaptest(void)
+{
+  int fd, i, pid;
+  char *p;
+
+  printf(stdout, "mmap test\n");
+  unlink("mmapfile");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "mmap test: create failed\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  for(i = 0; i < 4; i++)
+    write(fd, buf, sizeof(buf));
+
+  p = mmap(0, 4*sizeof(buf), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED){
+    printf(stdout, "mmap test: mmap failed\n");
+    exit();
+  }
+  if(p[0] != 'a' || p[4*sizeof(buf)-1] != buf[sizeof(buf)-1]){
+    printf(stdout, "mmap test: wrong contents\n");
+    exit();
+  }
+  p[1] = 'X';
+  pid = fork();
+  if(pid == 0){
+    p[2] = 'Y';
+    exit();
+  }
+  wait();
+  close(fd);
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, buf, 3) != 3 || buf[1] != 'X' || buf[2] != 'Y'){
+    printf(stdout, "mmap test: shared write not seen by read\n");
+    exit();
+  }
+  if(munmap(p, 4*sizeof(buf)) < 0){
+    printf(stdout, "mmap test: munmap failed\n");
+    exit();
+  }
+
+  p = mmap(0, sizeof(buf), PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED || p[1] != 'X'){
+    printf(stdout, "mmap test: shared write not written back\n");
+    exit();
+  }
+  p[0] = 'Z';
+  close(fd);
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, buf, 1) != 1 || buf[0] != 'a'){
+    printf(stdout, "mmap test: private write reached the file\n");
+    exit();
+  }
+  close(fd);
+  munmap(p, sizeof(buf));
+
+  pid = fork();
+  if(pid == 0){
+    p[0] = 0;   // unmapped; should kill the child
+    printf(stdout, "mmap test: write to unmapped page succeeded\n");
+    exit();
+  }
+  wait();
+  unlink("mmapfile");
+  printf(stdout, "mmap test ok\n");
+}
+
+// With a huge-page heap, memory given back by sbrk() inside a
+// 4MB page reads as zeroes when the heap grows into it again.
+void
+hugesbrktest(void)
+{
+  char *base, *h;
+  int i;
+
+  printf(stdout, "huge sbrk test\n");
+  hugeheap(1);
+  base = sbrk(0);
+  if(sbrk(8*1024*1024) == (char*)-1){
+    printf(stdout, "huge sbrk test: sbrk failed\n");
+    exit();
+  }
+  h = (char*)(((uint)base + 4*1024*1024 - 1) & ~(4*1024*1024 - 1));
+  memset(h, 0xaa, 4*1024*1024);
+  // Shrink to the middle of that 4MB page, and grow again.
+  sbrk(h + 2*1024*1024 - sbrk(0));
+  sbrk(base + 8*1024*1024 - sbrk(0));
+  for(i = 2*1024*1024; i < 4*1024*1024; i += 512){
+    if(h[i] != 0){
+      printf(stdout, "huge sbrk test: old data at %x\n", h + i);
+      exit();
+    }
+  }
+  if(h[2*1024*1024 - 1] != (char)0xaa){
+    printf(stdout, "huge sbrk test: kept memory lost\n");
+    exit();
+  }
+  sbrk(base - sbrk(0));
+  hugeheap(0);
+  printf(stdout, "huge sbrk test ok\n");
+}
+
+// clone() and join(): threads share memory, join() returns
+// each thread once, and futex_wait() sleeps until futex_wake().
+volatile int threadsum;
+volatile int futexword;
+char tstack[2][4096];
+
+void
+addthread(void *arg)
+{
+  __sync_fetch_and_add(&threadsum, (int)arg);
+}
+
+void
+futexthread(void *arg)
+{
+  while(futexword == 0)
+    futex_wait(&futexword, 0);
+  threadsum = futexword;
+}
+
+void
+threadtest(void)
+{
+  int t0, t1;
+
+  printf(stdout, "thread test\n");
+  threadsum = 0;
+  t0 = thread_create(addthread, (void*)3, tstack[0], sizeof(tstack[0]));
+  t1 = thread_create(addthread, (void*)4, tstack[1], sizeof(tstack[1]));
+  if(t0 < 0 || t1 < 0){
+    printf(stdout, "thread test: clone failed\n");
+    exit();
+  }
+  if(thread_join(t0) != t0 || thread_join(t1) != t1){
+    printf(stdout, "thread test: join failed\n");
+    exit();
+  }
+  if(thread_join(t0) != -1){
+    printf(stdout, "thread test: joined a thread twice\n");
+    exit();
+  }
+  if(threadsum != 7){
+    printf(stdout, "thread test: threads did not share memory\n");
+    exit();
+  }
+
+  // The word no longer holds val: futex_wait() returns at once.
+  futexword = 1;
+  futex_wait(&futexword, 0);
+  futexword = 0;
+  threadsum = 0;
+  t0 = thread_create(futexthread, 0, tstack[0], sizeof(tstack[0]));
+  sleep(2);
+  if(threadsum != 0){
+    printf(stdout, "thread test: futex_wait did not wait\n");
+    exit();
+  }
+  futexword = 42;
+  futex_wake(&futexword, 1);
+  if(thread_join(t0) != t0 || threadsum != 42){
+    printf(stdout, "thread test: futex_wake failed\n");
+    exit();
+  }
+  printf(stdout, "thread test ok\n");
+}
+
+// A thread closes a pipe's read end while another thread is
+// reading from it: the read still gets the data, and later
+// uses of the fd fail.
+int closefds[2];
+
+void
+pipereader(void *arg)
+{
+  char c;
+
+  threadsum = read(closefds[0], &c, 1) == 1 && c == 'p';
+}
+
+void
+closethread(void *arg)
+{
+  threadsum = close(closefds[0]);
+}
+
+void
+threadclose(void)
+{
+  int t;
+  char c;
+
+  printf(stdout, "thread close test\n");
+  if(pipe(closefds) != 0){
+    printf(stdout, "thread close test: pipe failed\n");
+    exit();
+  }
+  threadsum = 0;
+  t = thread_create(pipereader, 0, tstack[0], sizeof(tstack[0]));
+  sleep(2);
+  if(close(closefds[0]) != 0){
+    printf(stdout, "thread close test: close failed\n");
+    exit();
+  }
+  write(closefds[1], "p", 1);
+  if(thread_join(t) != t || threadsum != 1){
+    printf(stdout, "thread close test: read lost its file\n");
+    exit();
+  }
+  if(read(closefds[0], &c, 1) != -1){
+    printf(stdout, "thread close test: read a closed fd\n");
+    exit();
+  }
+
+  // Closed by another thread, gone for this one too.
+  if(pipe(closefds) != 0){
+    printf(stdout, "thread close test: pipe failed\n");
+    exit();
+  }
+  threadsum = -1;
+  t = thread_create(closethread, 0, tstack[0], sizeof(tstack[0]));
+  if(thread_join(t) != t || threadsum != 0 ||
+     read(closefds[0], &c, 1) != -1){
+    printf(stdout, "thread close test: fd survived close\n");
+    exit();
+  }
+  close(closefds[1]);
+  printf(stdout, "thread close test ok\n");
+}
+
+int
+same(char *a, char *b, int n)
+{
+  while(n-- > 0)
+    if(*a++ != *b++)
+      return 0;
+  return 1;
+}
+
+// readv() and writev() move the bytes of each buffer in order,
+// and pread() and pwrite() leave the file offset alone.
+void
+iovtest(void)
+{
+  struct iovec iov[3];
+  char a[5], b[7], c[3];
+  int fd;
+
+  printf(stdout, "iov test\n");
+  unlink("iovfile");
+  fd = open("iovfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "iov test: create failed\n");
+    exit();
+  }
+  iov[0].base = "hello";
+  iov[0].len = 5;
+  iov[1].base = ", ";
+  iov[1].len = 2;
+  iov[2].base = "world";
+  iov[2].len = 5;
+  if(writev(fd, iov, 3) != 12){
+    printf(stdout, "iov test: writev failed\n");
+    exit();
+  }
+  if(pwrite(fd, "W", 1, 7) != 1 || pread(fd, a, 5, 7) != 5 ||
+     !same(a, "World", 5)){
+    printf(stdout, "iov test: pwrite/pread failed\n");
+    exit();
+  }
+  // Both left the offset at the end of what writev() wrote.
+  if(write(fd, "!", 1) != 1){
+    printf(stdout, "iov test: write failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("iovfile", O_RDONLY);
+  iov[0].base = a;
+  iov[0].len = sizeof(a);
+  iov[1].base = b;
+  iov[1].len = sizeof(b);
+  iov[2].base = c;
+  iov[2].len = sizeof(c);
+  if(readv(fd, iov, 3) != 13 || !same(a, "hello", 5) ||
+     !same(b, ", World", 7) || c[0] != '!'){
+    printf(stdout, "iov test: readv got the wrong bytes\n");
+    exit();
+  }
+  if(pread(fd, a, 1, 0) != 1 || a[0] != 'h' || read(fd, a, 1) != 0){
+    printf(stdout, "iov test: pread moved the offset\n");
+    exit();
+  }
+  if(pread(fd, a, 1, -1) != -1 || readv(fd, iov, IOV_MAX+1) != -1){
+    printf(stdout, "iov test: bad arguments accepted\n");
+    exit();
+  }
+  close(fd);
+  unlink("iovfile");
+  printf(stdout, "iov test ok\n");
+}
+
+// splice() moves a file's bytes, from its offset on, into a pipe
+// or another file, and advances the offset.
+void
+splicetest(void)
+{
+  int in, out, fds[2], i, n;
+
+  printf(stdout, "splice test\n");
+  unlink("splicein");
+  unlink("spliceout");
+  in = open("splicein", O_CREATE|O_RDWR);
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 23;
+  if(in < 0 || write(in, buf, sizeof(buf)) != sizeof(buf)){
+    printf(stdout, "splice test: create failed\n");
+    exit();
+  }
+  close(in);
+
+  in = open("splicein", O_RDONLY);
+  out = open("spliceout", O_CREATE|O_RDWR);
+  if(read(in, buf, 100) != 100 ||
+     splice(in, out, sizeof(buf)) != sizeof(buf) - 100 ||
+     splice(in, out, 10) != 0){
+    printf(stdout, "splice test: splice to file failed\n");
+    exit();
+  }
+  close(out);
+  out = open("spliceout", O_RDONLY);
+  n = read(out, buf, sizeof(buf));
+  for(i = 0; i < n; i++)
+    if(buf[i] != 'a' + (i + 100) % 23)
+      break;
+  if(n != sizeof(buf) - 100 || i != n){
+    printf(stdout, "splice test: wrong bytes in file\n");
+    exit();
+  }
+  close(out);
+
+  if(pipe(fds) != 0){
+    printf(stdout, "splice test: pipe failed\n");
+    exit();
+  }
+  close(in);
+  in = open("splicein", O_RDONLY);
+  if(splice(in, fds[1], 300) != 300 || read(fds[0], buf, 300) != 300 ||
+     buf[0] != 'a' || buf[299] != 'a' + 299 % 23){
+    printf(stdout, "splice test: splice to pipe failed\n");
+    exit();
+  }
+  if(splice(fds[0], fds[1], 1) != -1){
+    printf(stdout, "splice test: spliced from a pipe\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(in);
+  unlink("splicein");
+  unlink("spliceout");
+  printf(stdout, "splice test ok\n");
+}
+
+// A process can have more than NOFILE files open, and fork()
+// gives the child all of them.
+void
+manyfds(void)
+{
+  int fds[40], i, pid;
+  char c;
+
+  printf(stdout, "many fds test\n");
+  unlink("fdfile");
+  fds[0] = open("fdfile", O_CREATE|O_RDWR);
+  if(fds[0] < 0 || write(fds[0], "abc", 3) != 3){
+    printf(stdout, "many fds test: create failed\n");
+    exit();
+  }
+  close(fds[0]);
+  for(i = 0; i < 40; i++){
+    if((fds[i] = open("fdfile", O_RDONLY)) < 0){
+      printf(stdout, "many fds test: open %d failed\n", i);
+      exit();
+    }
+  }
+  if(fds[39] < 17){
+    printf(stdout, "many fds test: fd %d too low\n", fds[39]);
+    exit();
+  }
+  if(read(fds[39], &c, 1) != 1 || c != 'a'){
+    printf(stdout, "many fds test: read from fd %d failed\n", fds[39]);
+    exit();
+  }
+  pid = fork();
+  if(pid == 0){
+    if(read(fds[39], &c, 1) != 1 || c != 'b' ||
+       read(fds[20], &c, 1) != 1 || c != 'a')
+      printf(stdout, "many fds test: child lost its fds\n");
+    exit();
+  }
+  wait();
+  for(i = 0; i < 40; i++)
+    close(fds[i]);
+  if(read(fds[39], &c, 1) != -1){
+    printf(stdout, "many fds test: read a closed fd\n");
+    exit();
+  }
+  unlink("fdfile");
+  printf(stdout, "many fds test ok\n");
+}
+
+// A system call cannot store into a read-only mapping.
+void
+rommaptest(void)
+{
+  int fd;
+  char *p;
+
+  printf(stdout, "read-only mmap test\n");
+  unlink("romfile");
+  fd = open("romfile", O_CREATE|O_RDWR);
+  write(fd, buf, 512);
+  p = mmap(0, 512, PROT_READ, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED){
+    printf(stdout, "read-only mmap test: mmap failed\n");
+    exit();
+  }
+  if(pread(fd, p, 10, 0) != -1){
+    printf(stdout, "read-only mmap test: read into mapping\n");
+    exit();
+  }
+  munmap(p, 512);
+  close(fd);
+  unlink("romfile");
+  printf(stdout, "read-only mmap test ok\n");
+}
+
 void
 uio()
 {
@@ -1796,6 +2243,14 @@ main(int argc, char *argv[])
   bigdir(); // slow
 
   uio();
+  mmaptest();
+  rommaptest();
+  hugesbrktest();
+  threadtest();
+  threadclose();
+  iovtest();
+  splicetest();
+  manyfds();
 
   exectest();
 
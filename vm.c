@@ -6,10 +6,16 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "traps.h"
+#include "kstat.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
+// Protects cpu->pgdir, cpu->pgdirfree and cpu->tlbstale of every CPU.
+struct spinlock pgdirlock;
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void
@@ -31,14 +37,17 @@ seginit(void)
 
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
-static pte_t *
+// create any required page table pages.  If va lies in
+// a 4MB page, return its page directory entry (with PTE_PS).
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    return pde;
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
@@ -57,7 +66,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -96,6 +105,10 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 //                                  rw data + free physical memory
 //   0xfe000000..0: mapped direct (devices such as ioapic)
 //
+// Above the first 4MB, which mixes read-only kernel text with
+// data, the kernel map uses 4MB pages (PTE_PS): fewer TLB entries,
+// and a single page table page per process for the kernel part.
+//
 // The kernel allocates physical memory for its heap and for user memory
 // between V2P(end) and the end of physical memory (PHYSTOP)
 // (directly addressable from end..P2V(PHYSTOP)).
@@ -114,6 +127,31 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
+// Like mappages(), but map the stretches of the range that are
+// 4MB-aligned in both va and pa with 4MB pages.
+static int
+mapkpages(pde_t *pgdir, uint va, uint size, uint pa, int perm)
+{
+  uint n;
+
+  while(size > 0){
+    if(va % HUGEPGSIZE == 0 && pa % HUGEPGSIZE == 0 && size >= HUGEPGSIZE){
+      n = HUGEPGSIZE;
+      if(pgdir[PDX(va)] & PTE_P)
+        panic("remap");
+      pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS;
+    } else {
+      n = PGSIZE;
+      if(mappages(pgdir, (void*)va, n, pa, perm) < 0)
+        return -1;
+    }
+    va += n;
+    pa += n;
+    size = size > n ? size - n : 0;
+  }
+  return 0;
+}
+
 // Set up kernel part of a page table.
 pde_t*
 setupkvm(void)
@@ -127,8 +165,8 @@ setupkvm(void)
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
+    if(mapkpages(pgdir, (uint)k->virt, k->phys_end - k->phys_start,
+                 (uint)k->phys_start, k->perm) < 0) {
       freevm(pgdir);
       return 0;
     }
@@ -140,6 +178,7 @@ setupkvm(void)
 void
 kvmalloc(void)
 {
+  initlock(&pgdirlock, "pgdir");
   kpgdir = setupkvm();
   switchkvm();
 }
@@ -152,10 +191,116 @@ switchkvm(void)
   lcr3(V2P(kpgdir));   // switch to the kernel page table
 }
 
+// Free the page table pages of a page table that freevm() has
+// already emptied of user memory, and the page directory itself.
+// A CPU whose cr3 still holds pgdir can walk the user page table
+// pages too, so they must wait for this as well.
+static void
+freepgdir(pde_t *pgdir)
+{
+  uint i;
+
+  for(i = 0; i < NPDENTRIES; i++){
+    if((pgdir[i] & PTE_P) && !(pgdir[i] & PTE_PS))
+      kfree(P2V(PTE_ADDR(pgdir[i])));
+  }
+  kfree((char*)pgdir);
+}
+
+// Flush the TLB after removing mappings from the current page
+// table. (switchuvm() reloads cr3 only when it has to.)
+void
+flushtlb(void)
+{
+  lcr3(rcr3());
+  kstatinc(KS_CR3LOAD);
+}
+
+// Flush this CPU's TLB if tlbshootdown() asked it to. Called from
+// the IPI, and from loops that wait with interrupts off, so that
+// two CPUs cannot end up waiting for each other.
+void
+tlbpoll(void)
+{
+  struct cpu *c = mycpu();
+
+  if(c->tlbflush){
+    lcr3(rcr3());
+    __sync_synchronize();
+    c->tlbflush = 0;
+  }
+}
+
+// Is c running a thread whose page table is pgdir?
+static int
+runningpgdir(struct cpu *c, pde_t *pgdir)
+{
+  struct proc *p = c->proc;
+
+  return p != 0 && p->pgdir == pgdir;
+}
+
+// The caller has just removed or changed PTEs of pgdir, which the
+// threads of one process share. Make the other CPUs drop their TLB
+// entries for it: those running one of the threads flush now,
+// through an IPI, and tlbshootdown() waits until they have; the
+// rest reload cr3 before they next run one (see switchuvm()).
+// Returns at once when no other CPU has pgdir loaded, or they all
+// know already, which is the usual case.
+void
+tlbshootdown(pde_t *pgdir)
+{
+  struct cpu *c, *me;
+  int wait;
+
+  pushcli();
+  me = mycpu();
+  __sync_synchronize();   // the PTE stores before the loads below
+  for(c = cpus; c < cpus+ncpu; c++)
+    if(c != me && c->pgdir == pgdir &&
+       (!c->tlbstale || runningpgdir(c, pgdir)))
+      break;
+  if(c == cpus+ncpu){
+    popcli();
+    return;
+  }
+
+  wait = 0;
+  acquire(&pgdirlock);
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(c == me || c->pgdir != pgdir)
+      continue;
+    c->tlbstale = 1;
+    if(runningpgdir(c, pgdir)){
+      c->tlbflush = 1;
+      lapicipi(c->apicid, T_IRQ0 + IRQ_TLB);
+      kstatinc(KS_TLBSHOOT);
+      wait = 1;
+    }
+  }
+  release(&pgdirlock);
+  for(c = cpus; wait && c < cpus+ncpu; c++){
+    while(c != me && c->tlbflush){
+      tlbpoll();
+      pause();
+    }
+  }
+  popcli();
+}
+
 // Switch TSS and h/w page table to correspond to process p.
+// The scheduler does not switch back to kpgdir when p stops
+// running, so cr3 often already holds p->pgdir; it is only
+// reloaded (flushing the TLB) if it does not, if p has run on
+// another CPU since, which may have changed its page table, or
+// if another thread of p's has changed it (see tlbshootdown()).
 void
 switchuvm(struct proc *p)
 {
+  struct cpu *c;
+  pde_t *old;
+  int oldfree;
+
   if(p == 0)
     panic("switchuvm: no process");
   if(p->kstack == 0)
@@ -173,7 +318,26 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
-  lcr3(V2P(p->pgdir));  // switch to process's address space
+  c = mycpu();
+  if(c->pgdir != p->pgdir || p->cpu != c || c->tlbstale){
+    acquire(&pgdirlock);
+    lcr3(V2P(p->pgdir));  // switch to process's address space
+    old = c->pgdir;
+    oldfree = c->pgdirfree;
+    c->pgdir = p->pgdir;
+    c->pgdirfree = 0;
+    c->tlbstale = 0;
+    // If the old page table was freed while loaded here,
+    // the last CPU to stop using it frees it.
+    for(c = cpus; oldfree && c < cpus+ncpu; c++)
+      if(c->pgdir == old)
+        oldfree = 0;
+    release(&pgdirlock);
+    if(oldfree)
+      freepgdir(old);
+    kstatinc(KS_CR3LOAD);
+  }
+  p->cpu = mycpu();
   popcli();
 }
 
@@ -192,46 +356,63 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
+// Load a program segment into pgdir.  addr must be page-aligned.
+// Whole pages of the file are mapped copy-on-write from the page
+// cache, so all processes running the program share them; a
+// partial last page is read into a private page.
 int
 loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
 {
-  uint i, pa, n;
-  pte_t *pte;
+  uint i, n, perm;
+  char *mem;
 
   if((uint) addr % PGSIZE != 0)
     panic("loaduvm: addr must be page aligned");
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
     if(sz - i < PGSIZE)
       n = sz - i;
     else
       n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
+    if(n == PGSIZE && (mem = pcache_get(ip, offset+i)) != 0){
+      perm = PTE_U|PTE_COW;
+    } else {
+      if((mem = kalloc()) == 0)
+        return -1;
+      memset(mem, 0, PGSIZE);
+      if(readi(ip, mem, offset+i, n) != n){
+        kfree(mem);
+        return -1;
+      }
+      perm = PTE_W|PTE_U;
+    }
+    if(mappages(pgdir, addr+i, PGSIZE, V2P(mem), perm) < 0){
+      kfree(mem);
       return -1;
+    }
   }
   return 0;
 }
 
 // Allocate page tables and physical memory to grow process from oldsz to
-// newsz, which need not be page aligned.  Returns new size or 0 on error.
+// newsz, which need not be page aligned.  Pages that are already
+// mapped (by loaduvm()) are left alone.  Returns new size or 0 on error.
 int
 allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
   char *mem;
   uint a;
+  pte_t *pte;
 
-  if(newsz >= KERNBASE)
+  if(newsz > MMAPBASE)
     return 0;
   if(newsz < oldsz)
     return oldsz;
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) != 0 && (*pte & PTE_P))
+      continue;
+    mem = kallocuser();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -248,6 +429,29 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   return newsz;
 }
 
+// Like allocuvm(), but back the 4MB-aligned stretches of the new
+// memory with 4MB pages while the pool lasts, for processes that
+// asked for a huge-page heap. Returns new size or 0 on error.
+int
+allochugeuvm(pde_t *pgdir, uint oldsz, uint newsz)
+{
+  char *mem;
+  uint a;
+
+  if(newsz > MMAPBASE)
+    return 0;
+  for(a = HUGEPGROUNDUP(oldsz); a + HUGEPGSIZE <= newsz; a += HUGEPGSIZE){
+    if(pgdir[PDX(a)] & PTE_P)
+      continue;
+    if((mem = khugealloc()) == 0)
+      break;
+    memset(mem, 0, HUGEPGSIZE);
+    pgdir[PDX(a)] = V2P(mem) | PTE_P | PTE_W | PTE_U | PTE_PS;
+  }
+  // The rest, and anything the pool could not cover, in 4KB pages.
+  return allocuvm(pgdir, oldsz, newsz);
+}
+
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
@@ -256,7 +460,7 @@ int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
   pte_t *pte;
-  uint a, pa;
+  uint a, pa, end;
 
   if(newsz >= oldsz)
     return oldsz;
@@ -266,13 +470,36 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-    else if((*pte & PTE_P) != 0){
+    else if(*pte & PTE_PS){
+      if(a % HUGEPGSIZE == 0){
+        // All of the 4MB page lies above newsz.
+        pa = PTE_ADDR(*pte);
+        *pte = 0;
+        tlbshootdown(pgdir);
+        khugefree(P2V(pa));
+      } else {
+        // newsz is inside it: keep the page, but clear the part
+        // being freed, since growing into it again (allocuvm()
+        // skips present pages) must find zeroes.
+        end = PGADDR(PDX(a) + 1, 0, 0);
+        if(end > oldsz)
+          end = oldsz;
+        memset((char*)P2V(PTE_ADDR(*pte)) + newsz % HUGEPGSIZE, 0,
+               end - newsz);
+      }
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    } else if(*pte & PTE_SWAP){
+      swapfree(PTE_ADDR(*pte) >> PGSHIFT);
+      *pte = 0;
+    } else if((*pte & PTE_P) != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
       char *v = P2V(pa);
-      kfree(v);
+      // Other threads must not use the page once it is free.
       *pte = 0;
+      tlbshootdown(pgdir);
+      kfree(v);
     }
   }
   return newsz;
@@ -283,18 +510,26 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 void
 freevm(pde_t *pgdir)
 {
-  uint i;
+  struct cpu *c;
+  int inuse;
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
-    if(pgdir[i] & PTE_P){
-      char * v = P2V(PTE_ADDR(pgdir[i]));
-      kfree(v);
+
+  // A CPU whose scheduler still runs on pgdir (see switchuvm())
+  // frees the page tables when it switches away.
+  inuse = 0;
+  acquire(&pgdirlock);
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(c->pgdir == pgdir){
+      c->pgdirfree = 1;
+      inuse = 1;
     }
   }
-  kfree((char*)pgdir);
+  release(&pgdirlock);
+  if(!inuse)
+    freepgdir(pgdir);
 }
 
 // Clear PTE_U on a page. Used to create an inaccessible
@@ -316,7 +551,7 @@ pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte;
+  pte_t *pte, *dpte;
   uint pa, i, flags;
   char *mem;
 
@@ -325,11 +560,37 @@ copyuvm(pde_t *pgdir, uint sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
       panic("copyuvm: pte should exist");
+    if(*pte & PTE_SWAP){
+      // Swapped out; the child shares the swap slot.
+      if((dpte = walkpgdir(d, (void *) i, 1)) == 0)
+        goto bad;
+      *dpte = *pte;
+      swapdup(PTE_ADDR(*pte) >> PGSHIFT);
+      continue;
+    }
     if(!(*pte & PTE_P))
       panic("copyuvm: page not present");
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(flags & PTE_PS){
+      // A 4MB page of a huge-page heap; always starts at i.
+      if((mem = khugealloc()) == 0)
+        goto bad;
+      memmove(mem, (char*)P2V(pa), HUGEPGSIZE);
+      d[PDX(i)] = V2P(mem) | flags;
+      i += HUGEPGSIZE - PGSIZE;
+      continue;
+    }
+    if(flags & PTE_COW){
+      // Shared page from the page cache; map it in the child too.
+      if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
+        goto bad;
+      kref(P2V(pa));
+      continue;
+    }
+    // kallocuser() may swap pages out, but not the current
+    // process's while it is in a system call (see swapvictim()).
+    if((mem = kallocuser()) == 0)
       goto bad;
     memmove(mem, (char*)P2V(pa), PGSIZE);
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0)
@@ -350,13 +611,233 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
+  if(*pte & PTE_PS)
+    return (char*)P2V(PTE_ADDR(*pte)) + ((uint)uva & (HUGEPGSIZE-1) & ~(PGSIZE-1));
   return (char*)P2V(PTE_ADDR(*pte));
 }
 
+// Give the copy-on-write page behind pte a private, writable copy.
+// If cansleep is set, the caller holds no spinlock, so memory can
+// be made by swapping. Returns 0 on success, -1 if out of memory.
+static int
+cowpage(pte_t *pte, int cansleep)
+{
+  char *mem, *v;
+  pte_t old;
+
+  old = *pte;
+  v = P2V(PTE_ADDR(old));
+  if(krefcount(v) == 1){
+    // Nobody else maps it any more; just take it over.
+    *pte = (*pte & ~PTE_COW) | PTE_W;
+    return 0;
+  }
+  if((mem = cansleep ? kallocuser() : kalloc()) == 0)
+    return -1;
+  memmove(mem, v, PGSIZE);
+  // Swapped out while kallocuser() slept, or copied by another
+  // thread of the process meanwhile: the access faults again.
+  if(!__sync_bool_compare_and_swap(pte, old,
+       V2P(mem) | (PTE_FLAGS(old) & ~PTE_COW) | PTE_W)){
+    kfree(mem);
+    return 0;
+  }
+  tlbshootdown(myproc()->pgdir);
+  kfree(v);
+  return 0;
+}
+
+// Handle a page fault at virtual address va in the current
+// process; err is the error code pushed by the processor.
+// Returns 0 if the fault has been resolved, -1 if the
+// access was bad. Pages are brought in under mmlock(), so
+// that two threads faulting on one page bring it in once.
+int
+pagefault(uint va, uint err)
+{
+  pte_t *pte;
+  int r;
+
+  if(va >= KERNBASE)
+    return -1;
+  pte = walkpgdir(myproc()->pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & PTE_P) == 0){
+    // A system call holding a spinlock cannot sleep for the
+    // page; checkptr() found it, so another thread has
+    // unmapped it since (see uvmscratch).
+    pushcli();
+    r = mycpu()->ncli > 1;
+    popcli();
+    if(r)
+      return -1;
+    mmlock();
+    pte = walkpgdir(myproc()->pgdir, (char*)va, 0);
+    if(pte && (*pte & PTE_SWAP))
+      r = swapin(pte);
+    else if(pte == 0 || (*pte & PTE_P) == 0)
+      r = mmapfault(va, err);
+    else
+      r = 0;   // another thread brought it in
+    mmunlock();
+    return r;
+  }
+  if((err & FEC_WR) && (*pte & PTE_COW)){
+    if(cowpage(pte, err & FEC_U) < 0){
+      cprintf("pagefault: out of memory\n");
+      return -1;
+    }
+    invlpg((void*)va);
+    return 0;
+  }
+  if((err & FEC_WR) && (*pte & PTE_W)){
+    // Another thread copied the page meanwhile, and this
+    // CPU's TLB had the old read-only entry.
+    invlpg((void*)va);
+    return 0;
+  }
+  return -1;
+}
+
+// A system call faulted at user address va, which pagefault()
+// could not resolve: another thread unmapped or shrank the memory
+// after checkptr() passed it. Put a private zeroed page there, or
+// a private copy of a read-only page, so that the system call can
+// finish; the caller kills the process. The page is freed with the
+// rest of the address space. Returns 0, or -1 if out of memory.
+int
+uvmscratch(uint va)
+{
+  pde_t *pde, old;
+  pte_t *pte;
+  char *mem;
+
+  pde = &myproc()->pgdir[PDX(va)];
+  old = *pde;
+  if(old & PTE_PS)
+    return -1;
+  if(!(old & PTE_P)){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(!__sync_bool_compare_and_swap(pde, old, V2P(mem)|PTE_P|PTE_W|PTE_U))
+      kfree(mem);
+  }
+  pte = walkpgdir(myproc()->pgdir, (char*)va, 0);
+  old = *pte;
+  if(old & PTE_SWAP)
+    return -1;
+  if(old & PTE_P){
+    if(!(old & (PTE_W|PTE_COW)) &&
+       !__sync_bool_compare_and_swap(pte, old, old | PTE_COW))
+      return 0;   // changed meanwhile; the access faults again
+    if((*pte & PTE_COW) && cowpage(pte, 0) < 0)
+      return -1;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(!__sync_bool_compare_and_swap(pte, old, V2P(mem)|PTE_P|PTE_W|PTE_U))
+      kfree(mem);
+  }
+  invlpg((void*)PGROUNDDOWN(va));
+  return 0;
+}
+
+// Give the current process a private copy of the page at user
+// address va if it is copy-on-write, so that the page is its own.
+// The page must be present (see uvmprefault).
+// Returns 0 on success, -1 if va is not mapped or out of memory.
+int
+uvmunshare(uint va)
+{
+  pte_t *pte;
+
+  pte = walkpgdir(myproc()->pgdir, (char*)va, 0);
+  if(pte == 0 || !(*pte & PTE_P))
+    return -1;
+  if(!(*pte & PTE_COW))
+    return 0;
+  if(cowpage(pte, 1) < 0)
+    return -1;
+  invlpg((void*)va);
+  return 0;
+}
+
+// Fault in the pages of [va, va+n) of the current process that are
+// swapped out or not yet read from a mapped file, so that a system
+// call can use them while holding a spinlock.
+// Returns 0 on success, -1 if some page cannot be had.
+int
+uvmprefault(uint va, uint n)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(myproc()->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_P))
+      continue;
+    if(pagefault(a, 0) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Check that the pages of [va, va+n) of the current process, which
+// uvmprefault() has brought in, can be written by the user: either
+// writable or copy-on-write. Returns 0 if so, else -1.
+int
+uvmwritable(uint va, uint n)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(myproc()->pgdir, (char*)a, 0);
+    if(pte == 0 || !(*pte & PTE_P) || !(*pte & PTE_U) ||
+       !(*pte & (PTE_W|PTE_COW)))
+      return -1;
+  }
+  return 0;
+}
+
+// Run the swap clock hand *va over [*va, sz) of pgdir, looking
+// for a private user page that has not been used since the hand
+// last went by; PTE_A is cleared on used pages as the hand passes.
+// Returns the page's PTE with *va set to its address, or 0 with
+// *va set to sz if the hand got to the end.
+pte_t*
+swapscan(pde_t *pgdir, uint *va, uint sz)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = *va; a < sz; a += PGSIZE){
+    if((pgdir[PDX(a)] & PTE_P) == 0 || (pgdir[PDX(a)] & PTE_PS)){
+      a = PGADDR(PDX(a), NPTENTRIES-1, 0);   // on to the next 4MB
+      continue;
+    }
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U) ||
+       krefcount(P2V(PTE_ADDR(*pte))) != 1)
+      continue;
+    if(*pte & PTE_A){
+      *pte &= ~PTE_A;
+      if(V2P(pgdir) == rcr3())
+        invlpg((void*)a);
+      continue;
+    }
+    *va = a;
+    return pte;
+  }
+  *va = sz;
+  return 0;
+}
+
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
 // uva2ka ensures this only works for PTE_U pages.
@@ -365,10 +846,17 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
   char *buf, *pa0;
   uint n, va0;
+  pte_t *pte;
 
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
+    pte = walkpgdir(pgdir, (char*)va0, 0);
+    if(pte && (*pte & PTE_COW)){
+      if(cowpage(pte, 1) < 0)
+        return -1;
+      invlpg((void*)va0);
+    }
     pa0 = uva2ka(pgdir, (char*)va0);
     if(pa0 == 0)
       return -1;
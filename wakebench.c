@@ -0,0 +1,96 @@
+// Wakeup benchmark: time a ping-pong through pipes, in which every
+// message is a wakeup, first alone and then with up to 64 other
+// processes asleep on unrelated channels (each reading its own
+// empty pipe). Reports round trips per second and how many
+// sleeping processes each wakeup() had to look at.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "kstat.h"
+
+#define NSLEEPER 64
+#define RUNTICKS 200
+#define HZ       100   // timer interrupts per second
+
+int
+pingpong(void)
+{
+  int p1[2], p2[2], n, t0;
+  char c;
+
+  pipe(p1);
+  pipe(p2);
+  if(fork() == 0){
+    close(p1[1]);
+    close(p2[0]);
+    while(read(p1[0], &c, 1) == 1)
+      write(p2[1], &c, 1);
+    exit();
+  }
+  close(p1[0]);
+  close(p2[1]);
+  t0 = uptime();
+  for(n = 0; uptime() - t0 < RUNTICKS; n++){
+    write(p1[1], "x", 1);
+    if(read(p2[0], &c, 1) != 1)
+      break;
+  }
+  close(p1[1]);
+  close(p2[0]);
+  wait();
+  return n;
+}
+
+void
+run(int nsleeper)
+{
+  int n, w0, s0, w;
+
+  w0 = kstat(KS_WAKEUP);
+  s0 = kstat(KS_WAKEUPSCAN);
+  n = pingpong();
+  w = kstat(KS_WAKEUP) - w0;
+  if(w == 0)
+    w = 1;
+  printf(1, "wakebench: %d sleepers: %d round trips/s, "
+         "%d wakeups, %d/100 sleepers looked at per wakeup\n",
+         nsleeper, n * HZ / RUNTICKS, w,
+         (kstat(KS_WAKEUPSCAN) - s0) * 100 / w);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pids[NSLEEPER], fd[2], i, n;
+  char c;
+
+  run(0);
+
+  // Each sleeper reads a pipe of its own that nothing is ever
+  // written to, until it is killed.
+  for(n = 0; n < NSLEEPER; n++){
+    if((pids[n] = fork()) < 0)
+      break;
+    if(pids[n] == 0){
+      pipe(fd);
+      read(fd[0], &c, 1);
+      exit();
+    }
+  }
+  if(n < NSLEEPER){
+    // The process table is full; make room for the ping-pong pair.
+    for(i = 0; i < 2 && n > 0; i++){
+      kill(pids[--n]);
+      wait();
+    }
+  }
+  sleep(10);
+  run(n);
+
+  for(i = 0; i < n; i++)
+    kill(pids[i]);
+  for(i = 0; i < n; i++)
+    wait();
+  exit();
+}
@@ -0,0 +1,62 @@
+// Log writeback benchmark. Times NWRITE small write() calls to a
+// file, each its own transaction, first with the writeback daemon
+// off, so that every commit installs its blocks before the call
+// returns, and then with it on. Reports the mean and worst latency
+// per call, and the disk requests made.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "kstat.h"
+
+#define NWRITE 1000
+#define WSIZE  64
+
+char *path = "wbbench.tmp";
+char buf[WSIZE];
+
+void
+run(int on)
+{
+  int i, fd, io, old;
+  uint64 t0, t1, s0;
+  uint t, worst;
+
+  if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+    printf(1, "wbbench: cannot create %s\n", path);
+    exit();
+  }
+  old = writeback(on);
+  io = kstat(KS_DISKIO);
+  worst = 0;
+  nsuptime(&s0);
+  for(i = 0; i < NWRITE; i++){
+    nsuptime(&t0);
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(1, "wbbench: write failed\n");
+      exit();
+    }
+    nsuptime(&t1);
+    t = (uint)(t1 - t0);
+    if(t > worst)
+      worst = t;
+  }
+  nsuptime(&t1);
+  io = kstat(KS_DISKIO) - io;
+  writeback(old);
+  close(fd);
+  unlink(path);
+  printf(1, "wbbench: daemon %s: %d writes of %d bytes, mean %d us, "
+         "worst %d us, %d disk requests\n", on ? "on " : "off",
+         NWRITE, WSIZE, (uint)(t1 - s0) / NWRITE / 1000, worst / 1000, io);
+}
+
+int
+main(int argc, char *argv[])
+{
+  memset(buf, 'w', sizeof(buf));
+  run(0);
+  run(1);
+  exit();
+}